@@ -15,28 +15,23 @@ void Suggester::load_text(const Rope& path) {
     m_text = path;
     m_keywords.clear();
 
-    for (std::size_t line = 0; line < m_text.line_count(); ++line) {
-        const auto line_text = m_text.substr(m_text.find_line_start(line),
-                                             m_text.line_length(line));
-        std::string word;
-
-        for (std::size_t i = 0; i < line_text.size(); ++i) {
-            if (!utils::is_symbol(line_text[i])) {
-                continue;
+    std::string word;
+
+    for (auto chunk = m_text.chunks(); !chunk.at_end(); ++chunk) {
+        for (char c : *chunk) {
+            if (utils::is_symbol(c)) {
+                word.push_back(c);
+            } else if (!word.empty()) {
+                m_keywords.push_back(word);
+                word.clear();
             }
-
-            word.clear();
-            std::size_t j = i + 1;
-            while (j < line_text.size() && utils::is_symbol(line_text[j])) {
-                ++j;
-            }
-
-            word = line_text.substr(i, j - i);
-            m_keywords.push_back(word);
-            i = j;
         }
     }
 
+    if (!word.empty()) {
+        m_keywords.push_back(word);
+    }
+
     std::sort(m_keywords.begin(), m_keywords.end());
     m_keywords.erase(std::unique(m_keywords.begin(), m_keywords.end()),
                      m_keywords.end());
@@ -2,28 +2,192 @@
 
 #include "constants.hpp"
 #include "cursor.hpp"
+#include "highlight/language.hpp"
 #include "nfd.hpp"
 #include "raylib.h"
+#include "rope/mapping.hpp"
 #include "rope/utils.hpp"
 #include "utils.hpp"
 
 #include <algorithm>
 #include <cctype>
-#include <cstring>
-#include <fstream>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <filesystem>
 #include <iostream>
+#include <memory>
 #include <optional>
+#include <stdexcept>
 #include <string_view>
 #include <tuple>
 #include <utility>
 #include <vector>
 
 #include <fcntl.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+namespace {
+
+// Writes a rope to a file straight from its leaves. Stretches that still
+// view `source`, the file as it was opened, are copied from it in the
+// kernel with copy_file_range, which shares the extents instead where the
+// file system supports reflinks. Everything else is handed to writev in
+// batches of iovecs. When `progress` is given, the number of bytes written
+// so far is added to it.
+class LeafWriter {
+public:
+    LeafWriter(int fd, const rope::Mapping* source,
+               std::atomic<std::size_t>* progress)
+        : m_fd{fd},
+          m_source{source},
+          m_progress{progress},
+          m_can_copy{source != nullptr} {
+        m_batch.reserve(IOV_MAX);
+    }
+
+    bool write(const Rope& rope) {
+        for (auto chunks = rope.chunks(); !chunks.at_end(); ++chunks) {
+            std::string_view chunk = *chunks;
+            if (chunk.empty()) {
+                continue;
+            }
+
+            bool ok = m_can_copy && m_source->contains(chunk)
+                        ? add_extent(chunk)
+                        : flush_extent() && add_iovec(chunk);
+            if (!ok) {
+                return false;
+            }
+        }
+
+        return flush_extent() && flush_batch();
+    }
+
+private:
+    int m_fd{};
+    const rope::Mapping* m_source{};
+    std::atomic<std::size_t>* m_progress{};
+    bool m_can_copy{};
+
+    std::vector<iovec> m_batch{};
+    // The run of the source waiting to be copied.
+    std::size_t m_extent_offset{};
+    std::size_t m_extent_length{};
+
+    bool add_iovec(std::string_view chunk) {
+        m_batch.push_back({const_cast<char*>(chunk.data()), chunk.size()});
+        return m_batch.size() < IOV_MAX || flush_batch();
+    }
+
+    bool add_extent(std::string_view chunk) {
+        auto offset
+            = static_cast<std::size_t>(chunk.data() - m_source->view().data());
+
+        if (m_extent_length > 0
+            && m_extent_offset + m_extent_length == offset) {
+            m_extent_length += chunk.size();
+            return true;
+        }
+
+        if (!flush_extent() || !flush_batch()) {
+            return false;
+        }
+
+        m_extent_offset = offset;
+        m_extent_length = chunk.size();
+        return true;
+    }
+
+    bool flush_extent() {
+        auto offset = static_cast<off_t>(m_extent_offset);
+        std::size_t length = std::exchange(m_extent_length, 0);
+
+        while (length > 0) {
+            ssize_t copied = copy_file_range(m_source->fd(), &offset, m_fd,
+                                             nullptr, length, 0);
+            if (copied > 0) {
+                length -= copied;
+                advance(copied);
+                continue;
+            }
+            if (copied == -1 && errno == EINTR) {
+                continue;
+            }
+            if (copied == 0
+                || (errno != EXDEV && errno != ENOSYS && errno != EINVAL
+                    && errno != EOPNOTSUPP)) {
+                return false;
+            }
+
+            // Copying is not supported between these files; write the rest
+            // from the mapping, and everything after it as well.
+            m_can_copy = false;
+            std::string_view rest = m_source->view().substr(offset, length);
+            return add_iovec(rest) && flush_batch();
+        }
+
+        return true;
+    }
+
+    bool flush_batch() {
+        std::size_t done = 0;
+
+        while (done < m_batch.size()) {
+            ssize_t written
+                = writev(m_fd, m_batch.data() + done,
+                         static_cast<int>(m_batch.size() - done));
+            if (written == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+
+            advance(written);
+
+            // Skip what was written, which may end partway into an iovec.
+            auto left = static_cast<std::size_t>(written);
+            while (done < m_batch.size() && left >= m_batch[done].iov_len) {
+                left -= m_batch[done].iov_len;
+                ++done;
+            }
+            if (done < m_batch.size()) {
+                m_batch[done].iov_base
+                    = static_cast<char*>(m_batch[done].iov_base) + left;
+                m_batch[done].iov_len -= left;
+            }
+        }
+
+        m_batch.clear();
+        return true;
+    }
+
+    void advance(std::size_t bytes) {
+        if (m_progress != nullptr) {
+            m_progress->fetch_add(bytes, std::memory_order_relaxed);
+        }
+    }
+};
+
+// Undoing back to a saved state usually restores the very same tree;
+// otherwise the content hashes cached in the nodes decide. The leaves of a
+// file are hashed as it is loaded, and an edit shares all but the path to
+// the edited leaves, so only those are hashed here. Equal hashes make equal
+// text very likely, but not certain; see Buffer::save.
+bool same_text(const Rope& a, const Rope& b) {
+    if (a.shares_root(b)) {
+        return true;
+    }
+
+    return a.length() == b.length() && a.hash() == b.hash();
+}
+
+} // namespace
+
 int View::lines(Vector2 char_size) {
     return static_cast<int>(GetScreenHeight() - constants::margin)
          / (char_size.y + constants::line_spacing);
@@ -58,45 +222,57 @@ bool View::viewable_column(int column, Vector2 char_size) const {
         && column < m_offset_column + columns(char_size);
 }
 
-Buffer::Buffer() : m_rope{"\n"} {
+Buffer::Buffer() : m_rope{"\n"}, m_saved{m_rope} {
     m_view.update_header_size(utils::number_len(m_rope.line_count()) + 2);
 }
 
 Buffer::Buffer(std::string_view filename) : m_filename{filename} {
-    std::ifstream file{filename.data()};
-    if (!file) {
-        throw std::runtime_error{"Could not open file"};
-    }
-
-    int fd = open(filename.data(), O_RDONLY, S_IRUSR | S_IWUSR);
-    struct stat sb;
+    m_highlights.set_language(Language::for_file(m_filename));
 
-    if (fstat(fd, &sb) == -1) {
-        throw std::runtime_error{"Could not get file size"};
-    }
+    auto mapping = std::make_shared<const rope::Mapping>(filename);
+    std::string_view text = mapping->view();
+    m_source = mapping;
 
-    if (sb.st_size == 0) {
-        m_rope = Rope{"\n"};
+    if (text.empty()) {
+        m_rope = m_saved = Rope{"\n"};
         return;
     }
 
-    char* file_in_memory = static_cast<char*>(
-        mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
-    std::size_t remaining = sb.st_size;
-    char* buf_ptr = file_in_memory;
+    // The leaves reference the mapping directly, so the file is paged in
+    // lazily and only the regions that get edited are ever copied.
     constexpr std::size_t buf_size = 1024 * 1024;
 
-    while (remaining >= buf_size) {
-        m_rope = m_rope.append(std::string(buf_ptr, buf_size));
-        buf_ptr += buf_size;
-        remaining -= buf_size;
+    if (text.size() <= buf_size) {
+        m_rope = m_saved = Rope::from_mapping(mapping, buf_size);
+        m_view.update_header_size(utils::number_len(m_rope.line_count()) + 2);
+        restore_session();
+        return;
     }
-    m_rope = m_rope.append(std::string(buf_ptr, remaining));
 
-    munmap(file_in_memory, sb.st_size);
-    close(fd);
+    // Show whole lines from the first chunk right away and index the rest
+    // of the file on another thread; poll_load() swaps in the full rope.
+    std::string_view head = text.substr(0, buf_size);
+    if (auto last_lf = head.rfind('\n'); last_lf != std::string_view::npos) {
+        head = head.substr(0, last_lf + 1);
+    }
 
+    m_rope = m_saved = Rope{rope::make<rope::MappedLeaf>(mapping, head)};
     m_view.update_header_size(utils::number_len(m_rope.line_count()) + 2);
+
+    m_loader = std::make_shared<Loader>();
+    m_loader->total = text.size();
+    // Closing the buffer destroys the loader, whose thread is then asked
+    // to stop rather than waited on until the whole file is indexed.
+    m_loader->thread = std::jthread{[loader = m_loader.get(),
+                                     mapping](std::stop_token stop) {
+        try {
+            loader->rope = Rope::from_mapping(mapping, buf_size,
+                                              &loader->loaded, stop);
+        } catch (...) {
+            loader->error = std::current_exception();
+        }
+        loader->done.store(true, std::memory_order_release);
+    }};
 }
 
 Cursor& Buffer::cursor() { return m_cursor; }
@@ -113,9 +289,15 @@ void Buffer::set_cursor(Cursor cursor) {
     }
 }
 
-Rope& Buffer::rope() { return m_rope; }
+Rope& Buffer::rope() {
+    flush();
+    return m_rope;
+}
 
-const Rope& Buffer::rope() const { return m_rope; }
+const Rope& Buffer::rope() const {
+    flush();
+    return m_rope;
+}
 
 View& Buffer::view() { return m_view; }
 
@@ -141,11 +323,153 @@ std::string& Buffer::filename() { return m_filename; }
 
 const std::string& Buffer::filename() const { return m_filename; }
 
-bool Buffer::dirty() const { return m_dirty; }
+bool Buffer::dirty() const {
+    // Typed text still in the gap counts as a change until it is flushed,
+    // which keeps this check cheap enough to run on every frame.
+    if (!m_gap.empty()) {
+        return true;
+    }
+
+    return !same_text(m_rope, m_saved);
+}
+
+std::size_t Buffer::line_count() const {
+    if (m_gap.empty()) {
+        return m_rope.line_count();
+    }
+
+    std::size_t lines = m_rope.line_count() + m_gap_lfcnt;
+
+    // Only a gap at the very end changes whether the text ends in an
+    // unterminated line.
+    if (m_gap_start == m_rope.length()) {
+        bool rope_open
+            = m_rope.length() == 0 || m_rope[m_rope.length() - 1] != '\n';
+        bool gap_open = m_gap.back() != '\n';
+        lines = lines - rope_open + gap_open;
+    }
+
+    return lines;
+}
+
+std::size_t Buffer::find_line_start(std::size_t line_index) const {
+    auto gap_line = static_cast<std::size_t>(m_gap_origin.line);
+    if (m_gap.empty() || line_index <= gap_line) {
+        return m_rope.find_line_start(line_index);
+    }
+
+    if (line_index > gap_line + m_gap_lfcnt) {
+        return m_rope.find_line_start(line_index - m_gap_lfcnt)
+             + m_gap.size();
+    }
+
+    // The line starts inside the gap.
+    std::size_t lf_index = line_index - gap_line - 1;
+    std::size_t pos = m_gap.find('\n');
+
+    for (; lf_index > 0; --lf_index) {
+        pos = m_gap.find('\n', pos + 1);
+    }
+
+    return m_gap_start + pos + 1;
+}
+
+std::size_t Buffer::index_from_pos(std::size_t line_index,
+                                   std::size_t line_pos) const {
+    return find_line_start(line_index) + line_pos;
+}
+
+std::string Buffer::substr(std::size_t start, std::size_t length) const {
+    if (m_gap.empty()) {
+        return m_rope.substr(start, length);
+    }
+
+    std::size_t end = std::min(start + length, m_rope.length() + m_gap.size());
+    std::size_t gap_end = m_gap_start + m_gap.size();
+    std::string result;
+
+    if (start < m_gap_start) {
+        result += m_rope.substr(start, std::min(end, m_gap_start) - start);
+    }
+
+    if (start < gap_end && end > m_gap_start) {
+        std::size_t from = std::max(start, m_gap_start) - m_gap_start;
+        std::size_t to = std::min(end, gap_end) - m_gap_start;
+        result.append(m_gap, from, to - from);
+    }
+
+    if (end > gap_end) {
+        std::size_t from = std::max(start, gap_end);
+        result += m_rope.substr(from - m_gap.size(), end - from);
+    }
+
+    return result;
+}
+
+void Buffer::flush() const {
+    if (m_gap.empty()) {
+        return;
+    }
+
+    apply(m_gap_start, 0, m_gap, m_gap_origin, m_gap_logged);
+    m_gap.clear();
+}
+
+HighlightCache& Buffer::highlights() { return m_highlights; }
+
+Lexer::State Buffer::line_state(std::size_t line_index) const {
+    return m_highlights.state(line_index, [this](std::size_t line) {
+        std::size_t start = find_line_start(line);
+        std::string text = substr(start, find_line_start(line + 1) - start);
+
+        if (!text.empty() && text.back() == '\n') {
+            text.pop_back();
+        }
+        return text;
+    });
+}
+
+bool Buffer::loading() const { return m_loader != nullptr; }
 
-void Buffer::mark_dirty() { m_dirty = true; }
+int Buffer::load_progress() const {
+    if (!m_loader) {
+        return 100;
+    }
+
+    return static_cast<int>(
+        m_loader->loaded.load(std::memory_order_relaxed) * 100
+        / m_loader->total);
+}
+
+void Buffer::poll_load() {
+    if (!m_loader || !m_loader->done.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    auto loader = std::exchange(m_loader, nullptr);
+
+    if (loader->error) {
+        std::rethrow_exception(loader->error);
+    }
+
+    // The head shown so far is a prefix of the full text, so the cursor and
+    // view stay where they are.
+    m_rope = m_saved = loader->rope;
+    m_highlights.clear();
+    m_view.update_header_size(utils::number_len(m_rope.line_count()) + 2);
+    restore_session();
+}
+
+void Buffer::restore_session() {
+    if (auto stamp = History::stamp(m_filename)) {
+        m_history.restore(m_filename, *stamp, m_rope);
+        m_recoverable = Journal::recoverable(m_filename, *stamp);
+    }
+}
 
 void Buffer::cursor_move_line(int delta) {
+    flush();
+
     const Vector2 char_size = utils::measure_text(" ", constants::font_size, 0);
 
     m_cursor.line = std::clamp(m_cursor.line + delta, 0,
@@ -164,6 +488,8 @@ void Buffer::cursor_move_line(int delta) {
 }
 
 void Buffer::cursor_move_column(int delta, bool move_on_eol) {
+    flush();
+
     const Vector2 char_size = utils::measure_text(" ", constants::font_size, 0);
     int line_length = m_rope.line_length(m_cursor.line);
 
@@ -188,6 +514,8 @@ void Buffer::cursor_move_column(int delta, bool move_on_eol) {
 }
 
 void Buffer::cursor_move_next_char() {
+    flush();
+
     if (m_cursor.column
         == static_cast<int>(m_rope.line_length(m_cursor.line))) {
         ++m_cursor.line;
@@ -198,6 +526,8 @@ void Buffer::cursor_move_next_char() {
 }
 
 void Buffer::cursor_move_prev_char() {
+    flush();
+
     if (m_cursor.column == 0) {
         --m_cursor.line;
         m_cursor.column = m_rope.line_length(m_cursor.line);
@@ -207,8 +537,12 @@ void Buffer::cursor_move_prev_char() {
 }
 
 void Buffer::cursor_move_next_word() {
-    std::size_t index = m_rope.index_from_pos(m_cursor.line, m_cursor.column);
-    char c = m_rope[index];
+    flush();
+
+    auto it
+        = m_rope.bytes(m_rope.index_from_pos(m_cursor.line, m_cursor.column));
+    const std::size_t length = m_rope.length();
+    char c = *it;
     bool alnum_word = !!std::isalnum(c);
     bool punct_word = !!std::ispunct(c);
 
@@ -217,22 +551,22 @@ void Buffer::cursor_move_next_word() {
 
     // if already in word, move to end of word
     if (alnum_word) {
-        while (index + 2 < m_rope.length() && std::isalnum(m_rope[index])) {
+        while (it.index() + 2 < length && std::isalnum(*it)) {
             cursor_move_next_char();
-            ++index;
+            ++it;
         }
-    } else if (index + 2 < m_rope.length() && punct_word) {
+    } else if (it.index() + 2 < length && punct_word) {
         cursor_move_next_char();
-        ++index;
-        if (std::ispunct(m_rope[index])) {
+        ++it;
+        if (std::ispunct(*it)) {
             return;
         }
     }
 
-    if (std::isspace(m_rope[index])) {
-        while (index + 2 < m_rope.length() && std::isspace(m_rope[index])) {
+    if (std::isspace(*it)) {
+        while (it.index() + 2 < length && std::isspace(*it)) {
             cursor_move_next_char();
-            ++index;
+            ++it;
         }
     }
 
@@ -243,26 +577,28 @@ void Buffer::cursor_move_next_word() {
 }
 
 void Buffer::cursor_move_prev_word() {
+    flush();
+
     if (m_cursor.line == 0 && m_cursor.column == 0) {
         return;
     }
 
     cursor_move_prev_char();
-    std::size_t index = m_rope.index_from_pos(m_cursor.line, m_cursor.column);
+    auto it
+        = m_rope.bytes(m_rope.index_from_pos(m_cursor.line, m_cursor.column));
 
-    while (index > 0 && std::isspace(m_rope[index])) {
+    while (it.index() > 0 && std::isspace(*it)) {
         cursor_move_prev_char();
-        --index;
+        --it;
     }
 
-    if (std::ispunct(m_rope[index])) {
+    if (std::ispunct(*it)) {
         return;
     }
 
     // if already in word, move to beginning of word
-    while (index > 0 && std::isalnum(m_rope[index - 1])) {
+    while (it.index() > 0 && std::isalnum(*--it)) {
         cursor_move_prev_char();
-        --index;
     }
 
     if (!m_view.viewable(m_cursor.line, m_cursor.column,
@@ -272,19 +608,58 @@ void Buffer::cursor_move_prev_word() {
 }
 
 void Buffer::insert_at_cursor(const std::string& text) {
-    std::size_t pos = m_rope.index_from_pos(m_cursor.line, m_cursor.column);
-    m_rope = m_rope.insert(pos, text);
-    m_dirty = true;
+    if (!m_gap.empty() && m_cursor != m_gap_cursor) {
+        flush();
+    }
 
-    for (auto _ = text.size(); _ > 0; --_) {
-        cursor_move_next_char();
+    if (m_gap.size() + text.size() > max_gap_size) {
+        flush();
+
+        std::size_t pos
+            = m_rope.index_from_pos(m_cursor.line, m_cursor.column);
+        change(pos, 0, text, m_cursor);
+
+        for (auto _ = text.size(); _ > 0; --_) {
+            cursor_move_next_char();
+        }
+        return;
+    }
+
+    if (m_gap.empty()) {
+        m_gap_start = m_rope.index_from_pos(m_cursor.line, m_cursor.column);
+        m_gap_origin = m_cursor;
+        m_gap_lfcnt = 0;
+        m_gap_logged = journal(m_rope) != nullptr;
     }
+
+    m_highlights.edit(m_gap_start + m_gap.size(), m_cursor.line, 0,
+                      std::count(text.begin(), text.end(), '\n'));
+
+    // The cursor ends up right after the inserted text, which can be worked
+    // out from the text alone without looking at the rope.
+    m_gap += text;
+    if (m_gap_logged) {
+        m_journal->edit(m_gap_start + m_gap.size() - text.size(), 0, text);
+    }
+
+    for (char c : text) {
+        if (c == '\n') {
+            ++m_cursor.line;
+            m_cursor.column = 0;
+            ++m_gap_lfcnt;
+        } else {
+            ++m_cursor.column;
+        }
+    }
+
+    m_gap_cursor = m_cursor;
 }
 
 void Buffer::append_at_cursor(const std::string& text) {
+    flush();
+
     std::size_t pos = m_rope.index_from_pos(m_cursor.line, m_cursor.column);
-    m_rope = m_rope.insert(pos + 1, text);
-    m_dirty = true;
+    change(pos + 1, 0, text, m_cursor);
 
     for (auto _ = text.size(); _ > 0; --_) {
         cursor_move_next_char();
@@ -292,19 +667,32 @@ void Buffer::append_at_cursor(const std::string& text) {
 }
 
 void Buffer::erase_at_cursor() {
+    // Backspacing over text typed in this run only shrinks the gap; it is
+    // undone together with the rest of the run.
+    if (!m_gap.empty() && m_cursor == m_gap_cursor && m_gap.back() != '\n') {
+        m_gap.pop_back();
+        if (m_gap_logged) {
+            m_journal->edit(m_gap_start + m_gap.size(), 1, "");
+        }
+        m_highlights.edit(m_gap_start + m_gap.size(), m_cursor.line, 0, 0);
+        --m_cursor.column;
+        m_gap_cursor = m_cursor;
+        return;
+    }
+
+    flush();
     std::size_t pos = m_rope.index_from_pos(m_cursor.line, m_cursor.column);
     if (pos == 0) {
         return;
     }
 
-    m_undo.emplace_back(m_rope, m_cursor);
-    m_redo.clear();
     cursor_move_prev_char();
-    m_rope = m_rope.erase(pos - 1, 1);
-    m_dirty = true;
+    change(pos - 1, 1, "", m_cursor);
 }
 
 void Buffer::erase_selected() {
+    flush();
+
     auto sel_start = select_start();
     auto sel_end = select_end();
 
@@ -316,20 +704,41 @@ void Buffer::erase_selected() {
 }
 
 void Buffer::erase_range(std::size_t start, std::size_t end) {
+    flush();
+
     copy_range(start, end);
 
-    m_undo.emplace_back(m_rope, select_start());
-    m_redo.clear();
-    m_rope = m_rope.erase(start, end - start);
-    m_dirty = true;
+    change(start, end - start, "", m_cursor);
 
     set_cursor(select_start());
     if (m_rope.length() == 0) {
-        m_rope = m_rope.append("\n");
+        change(0, 0, "\n", m_cursor);
+    }
+}
+
+void Buffer::erase(std::size_t start, std::size_t length) {
+    flush();
+    change(start, length, "", m_cursor);
+}
+
+void Buffer::replace_content(Rope content) {
+    flush();
+
+    History::Edit edit{0, m_rope, content};
+    m_rope = std::move(content);
+    m_history.record(std::move(edit), m_cursor, m_rope);
+    m_highlights.clear();
+
+    // A journal started here already begins with the new content.
+    bool started = m_journal != nullptr;
+    if (Journal* journal = this->journal(m_rope); journal && started) {
+        journal->checkpoint(m_rope);
     }
 }
 
 void Buffer::copy_selected() {
+    flush();
+
     auto sel_start = select_start();
     auto sel_end = select_end();
 
@@ -343,112 +752,366 @@ void Buffer::copy_selected() {
 }
 
 void Buffer::copy_range(std::size_t start, std::size_t end) {
+    flush();
+
     SetClipboardText(m_rope.substr(start, end - start).c_str());
 }
 
 void Buffer::save_snapshot() {
-    m_undo.push_back({m_rope, m_cursor, m_dirty});
-    m_redo.clear();
+    flush();
+    m_history.begin_step(m_cursor);
 }
 
 void Buffer::undo() {
-    if (m_undo.empty()) {
-        return;
-    }
+    flush();
 
-    m_redo.push_back({m_rope, m_cursor, m_dirty});
-    const auto& [prev_rope, prev_cursor, prev_dirty] = m_undo.back();
-    m_rope = prev_rope;
-    set_cursor(prev_cursor);
-    m_dirty = prev_dirty;
+    Rope before = m_rope;
+    std::size_t from = m_history.state();
 
-    m_undo.pop_back();
+    if (auto cursor = m_history.undo(m_rope, m_cursor)) {
+        set_cursor(*cursor);
+        note_move(before, from);
+    }
 }
 
 std::optional<Rope> Buffer::undo_top() {
-    if (m_undo.empty()) {
-        return {};
+    flush();
+    return m_history.peek_undo();
+}
+
+void Buffer::redo() {
+    flush();
+
+    Rope before = m_rope;
+    std::size_t from = m_history.state();
+
+    if (auto cursor = m_history.redo(m_rope)) {
+        set_cursor(*cursor);
+        note_move(before, from);
     }
+}
 
-    return m_undo.back().rope;
+std::size_t Buffer::undo_state() const { return m_history.state(); }
+
+History::Clock::time_point Buffer::undo_time() const {
+    return m_history.time();
 }
 
-void Buffer::redo() {
-    if (m_redo.empty()) {
+bool Buffer::undo_dropped() const { return m_history.dropped(); }
+
+void Buffer::travel(std::size_t state) {
+    flush();
+
+    Rope before = m_rope;
+    std::size_t from = m_history.state();
+
+    if (m_history.jump(m_rope, state)) {
+        cursor_move_line(0);
+        set_cursor(m_cursor);
+        note_move(before, from);
+    }
+}
+
+void Buffer::travel(History::Clock::time_point time) {
+    flush();
+
+    Rope before = m_rope;
+    std::size_t from = m_history.state();
+
+    if (m_history.jump(m_rope, time)) {
+        cursor_move_line(0);
+        set_cursor(m_cursor);
+        note_move(before, from);
+    }
+}
+
+void Buffer::apply(std::size_t position, std::size_t length,
+                   const std::string& text, Cursor cursor,
+                   bool logged) const {
+    Journal* journal = this->journal(m_rope);
+    History::Edit edit{position, length > 0 ? m_rope.slice(position, length)
+                                            : Rope{},
+                       Rope{text}};
+
+    if (length > 0) {
+        m_rope = m_rope.erase(position, length);
+    }
+    if (!text.empty()) {
+        m_rope = m_rope.insert(position, text);
+    }
+
+    m_history.record(std::move(edit), cursor, m_rope);
+
+    if (journal != nullptr) {
+        if (!logged) {
+            journal->edit(position, length, text);
+        }
+        if (journal->wants_checkpoint(m_rope.length())) {
+            journal->checkpoint(m_rope);
+        }
+    }
+}
+
+Journal* Buffer::journal(const Rope& text) const {
+    if (m_journal) {
+        return m_journal.get();
+    }
+
+    if (m_filename == "new file" || m_recoverable) {
+        return nullptr;
+    }
+
+    auto stamp = History::stamp(m_filename);
+    if (!stamp) {
+        return nullptr;
+    }
+
+    // While a save runs, the file may already hold the snapshot instead of
+    // the saved text, so only a checkpoint is sure to apply.
+    bool changed = saving() || !same_text(text, m_saved);
+    m_journal = std::make_unique<Journal>(m_filename, *stamp,
+                                          changed ? &text : nullptr);
+    return m_journal.get();
+}
+
+void Buffer::change(std::size_t position, std::size_t length,
+                    const std::string& text, Cursor cursor) {
+    std::size_t line = m_rope.line_index(position);
+    m_highlights.edit(position, line,
+                      m_rope.line_index(position + length) - line,
+                      std::count(text.begin(), text.end(), '\n'));
+
+    apply(position, length, text, cursor);
+}
+
+void Buffer::note_move(const Rope& before, std::size_t from) const {
+    auto edits = m_history.path(from, m_history.state());
+
+    // Replaying the edits finds the lines each of them touched.
+    Rope text = before;
+    for (const auto& edit : edits) {
+        std::size_t line = text.line_index(edit.position);
+        std::size_t end = edit.position + edit.removed.length();
+
+        m_highlights.edit(edit.position, line, text.line_index(end) - line,
+                          edit.inserted.line_index(edit.inserted.length()));
+        text = text.replace(edit.position, edit.removed.length(),
+                            edit.inserted);
+    }
+
+    Journal* journal = this->journal(before);
+    if (journal == nullptr) {
+        return;
+    }
+
+    std::size_t bytes = 0;
+    for (const auto& edit : edits) {
+        bytes += edit.inserted.length();
+    }
+
+    // Jumping across distant branches can take more text than there is.
+    if (bytes > m_rope.length()) {
+        journal->checkpoint(m_rope);
+        return;
+    }
+
+    for (const auto& edit : edits) {
+        journal->edit(edit);
+    }
+    if (journal->wants_checkpoint(m_rope.length())) {
+        journal->checkpoint(m_rope);
+    }
+}
+
+bool Buffer::recoverable() const { return m_recoverable; }
+
+void Buffer::recover() {
+    if (!m_recoverable || loading()) {
         return;
     }
 
-    m_undo.push_back({m_rope, m_cursor, m_dirty});
-    const auto& [next_rope, next_cursor, next_dirty] = m_redo.back();
-    m_rope = next_rope;
-    set_cursor(next_cursor);
-    m_dirty = next_dirty;
+    flush();
+    m_recoverable = false;
+
+    std::optional<Rope> text;
+    if (auto stamp = History::stamp(m_filename)) {
+        text = Journal::recover(m_filename, *stamp, m_saved);
+    }
+
+    if (!text || same_text(*text, m_rope)) {
+        std::cerr << "Nothing to recover for " << m_filename << "\n";
+        return;
+    }
 
-    m_redo.pop_back();
+    save_snapshot();
+    replace_content(std::move(*text));
+    cursor_move_line(0);
+    set_cursor(m_cursor);
+    std::cerr << "Recovered " << m_filename << "\n";
 }
 
 void Buffer::save() {
+    if (loading()) {
+        std::cerr << "Still loading " << m_filename << "\n";
+        return;
+    }
+
+    flush();
+
     if (m_filename == "new file") {
         save_as();
         return;
     }
 
-    if (!m_dirty) {
+    // Equal hashes make unchanged text very likely but not certain, so the
+    // texts are compared before a save is skipped. Subtrees shared with the
+    // saved text are equal by identity, which keeps this cheap.
+    if (m_rope == m_saved) {
         return;
     }
 
-    int fd = open(m_filename.data(), O_RDWR | O_CREAT | O_TRUNC, (mode_t)0600);
-    if (fd == -1) {
-        throw std::runtime_error{"Could not open file"};
+    start_save();
+}
+
+bool Buffer::saving() const { return m_saver != nullptr; }
+
+int Buffer::save_progress() const {
+    if (!m_saver || m_saver->total == 0) {
+        return 100;
     }
 
-    std::size_t text_size = m_rope.length();
+    return static_cast<int>(
+        m_saver->written.load(std::memory_order_relaxed) * 100
+        / m_saver->total);
+}
 
-    if (lseek(fd, text_size - 1, SEEK_SET) == -1) {
-        close(fd);
-        throw std::runtime_error{"Could not seek to end of file"};
+void Buffer::poll_save() {
+    if (!m_saver || !m_saver->done.load(std::memory_order_acquire)) {
+        return;
     }
 
-    if (write(fd, "", 1) == -1) {
-        close(fd);
-        throw std::runtime_error{"Could not write to file"};
+    auto saver = std::exchange(m_saver, nullptr);
+
+    if (saver->error) {
+        std::rethrow_exception(saver->error);
     }
 
-    char* map = static_cast<char*>(
-        mmap(0, text_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    std::cerr << "Saved " << saver->filename << "\n";
+    // The file holds the snapshot, whatever has been edited since.
+    m_saved = saver->rope;
 
-    if (map == MAP_FAILED) {
-        close(fd);
-        throw std::runtime_error{"Could not mmap file"};
+    // The journal applies to the file as it was, so it is started afresh
+    // from what has been edited since, if anything, typing included.
+    flush();
+    if (m_journal) {
+        m_journal->discard();
+        m_journal.reset();
+    }
+    if (m_recoverable) {
+        unlink(Journal::path(saver->filename).c_str());
+        m_recoverable = false;
+    }
+    if (dirty()) {
+        journal(m_rope);
     }
 
-    constexpr std::size_t buf_size = 1024 * 1024;
-    std::size_t i;
+    // The file is saved either way, so a history that cannot be stored is
+    // only reported.
+    try {
+        if (auto stamp = History::stamp(saver->filename)) {
+            m_history.store(saver->filename, *stamp, saver->state);
+        }
+    } catch (const std::runtime_error& error) {
+        std::cerr << error.what() << "\n";
+    }
+}
 
-    for (i = 0; i + buf_size < text_size; i += buf_size) {
-        std::strncpy(map + i, m_rope.substr(i, buf_size).c_str(), buf_size);
+void Buffer::start_save() {
+    if (saving()) {
+        std::cerr << "Still saving " << m_filename << "\n";
+        return;
     }
 
-    std::strncpy(map + i, m_rope.substr(i, text_size - i).c_str(),
-                 text_size - i);
+    flush();
+
+    // Edits made during the save go into a new undo step, so that the
+    // state the file is saved from stays as it is.
+    m_history.begin_step(m_cursor);
+
+    m_saver = std::make_shared<Saver>();
+    m_saver->filename = m_filename;
+    m_saver->state = m_history.state();
+    m_saver->total = m_rope.length();
+    m_saver->rope = m_rope;
+    m_saver->thread = std::jthread{[saver = m_saver.get(),
+                                    source = m_source.get()] {
+        try {
+            write_file(saver->filename, saver->rope, source, &saver->written);
+        } catch (...) {
+            saver->error = std::current_exception();
+        }
+        saver->done.store(true, std::memory_order_release);
+    }};
+}
+
+void Buffer::write_file(const std::string& filename, const Rope& text,
+                        const rope::Mapping* source,
+                        std::atomic<std::size_t>* progress) {
+    // The rope may still reference the mapping of the file being replaced, so
+    // truncating it in place would pull the pages out from under the leaves.
+    // Write to a sibling file instead and move it over the original.
+    std::string tmp_filename = filename + ".jaledit-tmp";
+    mode_t mode = 0600;
+    struct stat sb;
+
+    if (stat(filename.c_str(), &sb) == 0) {
+        mode = sb.st_mode & 07777;
+    }
 
-    if (msync(map, text_size, MS_SYNC) == -1) {
+    int fd = open(tmp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (fd == -1) {
+        throw std::runtime_error{"Could not open file"};
+    }
+
+    if (!LeafWriter{fd, source, progress}.write(text)) {
         close(fd);
-        munmap(map, text_size);
-        throw std::runtime_error{"Could not sync file"};
+        unlink(tmp_filename.c_str());
+        throw std::runtime_error{"Could not write to file"};
     }
 
-    if (munmap(map, text_size) == -1) {
+    if (fsync(fd) == -1) {
         close(fd);
-        throw std::runtime_error{"Could not unmap file"};
+        unlink(tmp_filename.c_str());
+        throw std::runtime_error{"Could not sync file"};
     }
 
     close(fd);
-    std::cerr << "Saved " << m_filename << "\n";
-    m_dirty = false;
+
+    if (std::rename(tmp_filename.c_str(), filename.c_str()) == -1) {
+        unlink(tmp_filename.c_str());
+        throw std::runtime_error{"Could not replace file"};
+    }
+
+    // The rename is only durable once the directory entry is on disk too.
+    // Not every file system can sync a directory, so failing here is fine.
+    std::string directory
+        = std::filesystem::path{filename}.parent_path().string();
+    int dir_fd = open(directory.empty() ? "." : directory.c_str(),
+                      O_RDONLY | O_DIRECTORY);
+    if (dir_fd != -1) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
 }
 
 void Buffer::save_as() {
+    // Checked before the buffer is renamed: start_save() would refuse the
+    // save later on, and the new file would never be written.
+    if (saving()) {
+        std::cerr << "Still saving " << m_filename << "\n";
+        return;
+    }
+
     NFD::Guard nfd_guard;
     NFD::UniquePath out_path;
 
@@ -460,8 +1123,8 @@ void Buffer::save_as() {
     }
 
     m_filename = out_path.get();
-    m_dirty = true;
+    m_highlights.set_language(Language::for_file(m_filename));
 
     std::cerr << "Saving as " << m_filename << "\n";
-    save();
-}
\ No newline at end of file
+    start_save();
+}
@@ -2,14 +2,22 @@
 
 #include "autocomplete/suggester.hpp"
 #include "cursor.hpp"
+#include "highlight/cache.hpp"
+#include "rope/mapping.hpp"
 #include "rope/rope.hpp"
+#include "undo/history.hpp"
+#include "undo/journal.hpp"
 
 #include "raylib.h"
 
+#include <atomic>
 #include <cstddef>
+#include <exception>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -61,7 +69,32 @@ public:
     const std::string& filename() const;
 
     bool dirty() const;
-    void mark_dirty();
+
+    // Text queries that also see typed text still held in the gap, so that
+    // drawing the buffer does not flush it on every frame.
+    std::size_t line_count() const;
+    std::size_t find_line_start(std::size_t line_index) const;
+    std::size_t index_from_pos(std::size_t line_index,
+                               std::size_t line_pos) const;
+    std::string substr(std::size_t start, std::size_t length) const;
+
+    // Highlighted lines as last drawn, dropped as the text changes.
+    HighlightCache& highlights();
+    // The lexer state line `line_index` starts in.
+    Lexer::State line_state(std::size_t line_index) const;
+
+    // Inserts the text typed since the last flush into the rope. Every
+    // other read of the rope, and every edit elsewhere, flushes first.
+    void flush() const;
+
+    // True while a large file is still being read in the background. Until
+    // it finishes, the rope holds only the start of the file and the buffer
+    // refuses edits and saves.
+    bool loading() const;
+    // Percentage of the file read so far by a background load.
+    int load_progress() const;
+    // Swaps in the complete rope once a background load has finished.
+    void poll_load();
 
     void cursor_move_line(int delta);
     void cursor_move_column(int delta, bool move_on_eol);
@@ -75,43 +108,138 @@ public:
     void erase_at_cursor();
     void erase_selected();
     void erase_range(std::size_t start, std::size_t end);
+    void erase(std::size_t start, std::size_t length);
+    // Replaces the whole text, as a single undoable edit.
+    void replace_content(Rope content);
     void copy_selected();
     void copy_range(std::size_t start, std::size_t end);
 
     void undo();
+    // The text as it was before the latest undo step.
     std::optional<Rope> undo_top();
     void redo();
+    // Number and creation time of the current undo state.
+    std::size_t undo_state() const;
+    History::Clock::time_point undo_time() const;
+    // True once the undo history stored with the file has turned out
+    // damaged and been dropped.
+    bool undo_dropped() const;
+    // Moves to another undo state, on any branch, by number or by time.
+    void travel(std::size_t state);
+    void travel(History::Clock::time_point time);
+    // Starts a new undo step at the current cursor.
     void save_snapshot();
     void save();
     void save_as();
+    // True while a save runs in the background. Editing carries on; the
+    // file gets the text as it was when the save started.
+    bool saving() const;
+    // Percentage of the text written so far by a background save.
+    int save_progress() const;
+    // Marks the saved text as clean once a background save has finished.
+    void poll_save();
+
+    // True if a journal of unsaved changes was left for the file, by an
+    // editor that did not get to save them. Until they are recovered, new
+    // changes are not journaled, so that the old journal stays intact.
+    bool recoverable() const;
+    // Replaces the text with the one the journal left for the file ends
+    // at, as a single undoable edit.
+    void recover();
 
 private:
-    struct Snapshot {
-        Rope rope;
-        Cursor cursor;
-        bool dirty;
+    // State shared with the thread that builds the rope of a large file.
+    // Only `loaded` and `done` are touched by both sides; the rope belongs
+    // to the loading thread until `done` is set.
+    struct Loader {
+        std::size_t total{};
+        std::atomic<std::size_t> loaded{};
+        std::atomic<bool> done{};
+        Rope rope{};
+        std::exception_ptr error{};
+        std::jthread thread{};
     };
 
-    // The value of 32 is small enough for demo purposes,
-    // but in a real editor this value would be much larger.
-    // static constexpr std::size_t max_gap_size = 32;
-
-    Rope m_rope{};
-
-    std::vector<Snapshot> m_undo{};
-    std::vector<Snapshot> m_redo{};
+    // State shared with the thread that writes a snapshot of the rope to
+    // disk. The saving thread only reads `rope` through plain pointers, so
+    // reference counts are only ever touched here.
+    struct Saver {
+        std::string filename{};
+        // The undo state the snapshot was taken from.
+        std::size_t state{};
+        std::size_t total{};
+        std::atomic<std::size_t> written{};
+        std::atomic<bool> done{};
+        Rope rope{};
+        std::exception_ptr error{};
+        std::jthread thread{};
+    };
 
-    // std::string m_gap{};
-    // std::size_t m_gap_start{};
+    // Typing runs longer than this are flushed into the rope in pieces.
+    static constexpr std::size_t max_gap_size = 1024;
+
+    mutable Rope m_rope{};
+    // The content as of the last load or save; dirty() compares against it.
+    Rope m_saved{};
+    // The file as it was opened. Saving copies the parts of the text that
+    // still view it from the file instead of from memory.
+    rope::Mapping::Handle m_source{};
+
+    // Every change to m_rope goes through apply(), which records it here.
+    mutable History m_history{};
+
+    // Changes since the last save are also logged here, once there are
+    // any, so that they survive a crash.
+    mutable std::unique_ptr<Journal> m_journal{};
+    bool m_recoverable{};
+
+    // Characters typed at the cursor since the last flush. They belong at
+    // m_gap_start in the rope, where the cursor stood at m_gap_origin;
+    // m_gap_cursor is where it stood after the last of them, so that any
+    // other cursor position means the run has ended. Unless the journal
+    // was not running when the run began, m_gap_logged is set and each
+    // keystroke is logged as it comes, rather than once the run is flushed.
+    mutable std::string m_gap{};
+    std::size_t m_gap_start{};
+    Cursor m_gap_origin{};
+    std::size_t m_gap_lfcnt{};
+    Cursor m_gap_cursor{};
+    bool m_gap_logged{};
 
     Cursor m_cursor{};
     View m_view{};
+    mutable HighlightCache m_highlights{};
 
     Cursor m_select_orig{-1, -1};
 
     std::string m_filename{"new file"};
 
-    bool m_dirty{};
-
     Suggester m_suggester{};
+
+    std::shared_ptr<Loader> m_loader{};
+    std::shared_ptr<Saver> m_saver{};
+
+    // Replaces `length` bytes at `position` by `text`; undoing the change
+    // puts the cursor back at `cursor`. A change already `logged` in the
+    // journal is not logged again.
+    void apply(std::size_t position, std::size_t length,
+               const std::string& text, Cursor cursor,
+               bool logged = false) const;
+    // Like apply(), for edits to text already drawn. Text typed into the
+    // gap was drawn before it is applied.
+    void change(std::size_t position, std::size_t length,
+                const std::string& text, Cursor cursor);
+    // The journal, started on first use. `text` is the text the changes
+    // about to be logged apply to.
+    Journal* journal(const Rope& text) const;
+    // Notes the move through the undo history from state `from`, which
+    // left `before` behind, in the highlighting and the journal.
+    void note_move(const Rope& before, std::size_t from) const;
+    void start_save();
+    static void write_file(const std::string& filename, const Rope& text,
+                           const rope::Mapping* source,
+                           std::atomic<std::size_t>* progress);
+    // Picks up the undo history stored with the file, if it is current,
+    // and checks for a journal left by a crash.
+    void restore_session();
 };
\ No newline at end of file
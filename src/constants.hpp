@@ -25,5 +25,6 @@ constexpr int char_limit = 1 << 8;
 constexpr int max_buffer_lines = 1 << 20;
 constexpr int line_spacing = 2;
 constexpr int max_line_length = INT_MAX / 4 * 3;
+constexpr int undo_time_step = 60; // seconds
 
 } // namespace constants
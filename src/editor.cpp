@@ -1,7 +1,7 @@
 #include "editor.hpp"
 
 #include "constants.hpp"
-#include "highlight/highlight.hpp"
+#include "highlight/cache.hpp"
 #include "keybind/keybind.hpp"
 #include "nfd.hpp"
 #include "raylib.h"
@@ -9,8 +9,10 @@
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <climits>
 #include <string_view>
+#include <utility>
 
 Editor::Editor() {
     m_keybinds.insert(
@@ -117,6 +119,40 @@ Editor::Editor() {
         "u", [this] { current_buffer().undo(); }, true);
     m_keybinds.insert(
         "r", [this] { current_buffer().redo(); }, true);
+    m_keybinds.insert(
+        "R", [this] { current_buffer().recover(); }, true);
+    m_keybinds.insert(
+        "g-",
+        [this] {
+            auto& buffer = current_buffer();
+            if (buffer.undo_state() > 0) {
+                buffer.travel(buffer.undo_state() - 1);
+            }
+        },
+        true);
+    m_keybinds.insert(
+        "g+",
+        [this] {
+            auto& buffer = current_buffer();
+            buffer.travel(buffer.undo_state() + 1);
+        },
+        true);
+    m_keybinds.insert(
+        "g<",
+        [this] {
+            auto& buffer = current_buffer();
+            buffer.travel(buffer.undo_time()
+                          - std::chrono::seconds{constants::undo_time_step});
+        },
+        true);
+    m_keybinds.insert(
+        "g>",
+        [this] {
+            auto& buffer = current_buffer();
+            buffer.travel(buffer.undo_time()
+                          + std::chrono::seconds{constants::undo_time_step});
+        },
+        true);
     m_keybinds.insert(
         "x",
         [this] {
@@ -130,6 +166,7 @@ Editor::Editor() {
                 return;
             }
 
+            buffer.save_snapshot();
             buffer.cursor_move_next_char();
             buffer.erase_at_cursor();
 
@@ -288,6 +325,30 @@ void Editor::render_status_bar() {
     utils::draw_text(status.data(), {constants::margin, 0}, BLACK,
                      constants::font_size, 0);
 
+    // draw load or save progress, the offer to recover, or the loss of the
+    // undo history
+    const char* progress = nullptr;
+
+    if (current_buffer().loading()) {
+        progress
+            = TextFormat("LOADING %d%%", current_buffer().load_progress());
+    } else if (current_buffer().saving()) {
+        progress = TextFormat("SAVING %d%%", current_buffer().save_progress());
+    } else if (current_buffer().recoverable()) {
+        progress = "UNSAVED CHANGES FOUND, R TO RECOVER";
+    } else if (current_buffer().undo_dropped()) {
+        progress = "UNDO HISTORY DAMAGED, DROPPED";
+    }
+
+    if (progress != nullptr) {
+        float status_width
+            = utils::measure_text(status.data(), constants::font_size, 0).x;
+
+        utils::draw_text(progress,
+                         {2 * constants::margin + status_width, 0}, BLACK,
+                         constants::font_size, 0);
+    }
+
     // draw filename
     if (m_mode != EditorMode::BufferList) {
         std::string_view filename = current_buffer().filename();
@@ -317,8 +378,11 @@ void Editor::render_buffer() {
     const std::size_t line_width = char_size.x;
 
     const auto& cursor = current_buffer().cursor();
-    const auto& content = current_buffer().rope();
+    // Read through the buffer rather than its rope, so that text typed in
+    // insert mode is drawn without being flushed first.
+    const auto& content = current_buffer();
     auto& view = current_buffer().view();
+    auto& highlights = current_buffer().highlights();
 
     const int max_line_number_size = utils::number_len(content.line_count());
     const int offset_from_number = 2;
@@ -361,7 +425,15 @@ void Editor::render_buffer() {
             = std::min(line_len - 1,
                        static_cast<std::size_t>(view.columns(char_size) - 1));
 
-        std::string line = content.substr(render_line_start, render_line_len);
+        // Only lines that changed since the last frame are read and lexed.
+        const auto* line = highlights.find(cur_line_idx, render_line_start,
+                                           render_line_len);
+        if (line == nullptr) {
+            line = &highlights.insert(
+                cur_line_idx, render_line_start, line_start + line_len,
+                content.substr(render_line_start, render_line_len),
+                content.line_state(cur_line_idx));
+        }
 
         const char* line_number
             = TextFormat("%-*d", header_width + 1, cur_line_idx + 1);
@@ -370,24 +442,12 @@ void Editor::render_buffer() {
                          constants::font_size, 0);
 
         float x = constants::margin + (header_width + 1) * char_size.x;
-        Highlighter highlighter(line);
-        HighlightedToken token;
 
-        while (true) {
-            token = highlighter.next();
+        for (const auto& span : line->spans) {
+            utils::draw_text(line->text.data() + span.offset, {x, y},
+                             span.color, constants::font_size, 0);
 
-            if (token.token.kind() == TokenKind::End) {
-                break;
-            }
-
-            std::string_view text = token.token.text() == "\t"
-                                      ? std::string(8, ' ')
-                                      : token.token.text();
-
-            utils::draw_text(text.data(), {x, y}, token.color,
-                             constants::font_size, 0);
-
-            x += text.size() * char_size.x;
+            x += span.length * char_size.x;
         }
 
         if (m_mode == EditorMode::Visual) {
@@ -533,6 +593,11 @@ Key modify_key(int key, int prev_key) {
 }
 
 void Editor::update() {
+    for (auto& buffer : m_buffers) {
+        buffer.poll_load();
+        buffer.poll_save();
+    }
+
     static int prev_key = KEY_NULL;
     Key rv;
     int key = GetKeyPressed();
@@ -590,6 +655,8 @@ Buffer& Editor::current_buffer() { return m_buffers[m_buffer_id]; }
 const Buffer& Editor::current_buffer() const { return m_buffers[m_buffer_id]; }
 
 void Editor::set_mode(EditorMode mode) {
+    current_buffer().flush();
+
     if (mode == EditorMode::Insert) {
         current_buffer().save_snapshot();
     }
@@ -608,7 +675,7 @@ void Editor::set_mode(EditorMode mode) {
             rope = rope.append(buffer.filename()).append("\n");
         }
 
-        m_buffers.emplace_back(buffer_list);
+        m_buffers.push_back(std::move(buffer_list));
         m_prev_buffer_id = m_buffer_id;
         m_buffer_id = m_buffers.size() - 1;
     }
@@ -649,7 +716,8 @@ void Editor::normal_mode(Key key) {
     if (key.modifier != KEY_NULL) {
         m_keybinds.reset_step();
     } else {
-        m_keybinds.step(key.key, m_mode != EditorMode::BufferList);
+        m_keybinds.step(key.key, m_mode != EditorMode::BufferList
+                                     && !current_buffer().loading());
     }
 }
 
@@ -715,7 +783,7 @@ void Editor::insert_mode(Key key) {
         if (current_buffer().suggester().rendering()) {
             auto& buffer = current_buffer();
             auto& cursor = buffer.cursor();
-            auto& rope = buffer.rope();
+            const auto& rope = buffer.rope();
 
             std::size_t end = rope.index_from_pos(cursor.line, cursor.column);
             buffer.cursor_move_prev_word();
@@ -723,7 +791,7 @@ void Editor::insert_mode(Key key) {
 
             auto& suggester = buffer.suggester();
 
-            rope = rope.erase(start, end - start);
+            buffer.erase(start, end - start);
             buffer.insert_at_cursor(suggester.select());
 
             suggester.to_render(false);
@@ -757,6 +825,11 @@ void Editor::visual_mode(Key key) {
     if (key.modifier == KEY_NULL) {
         switch (key.key) {
         case 'd':
+            if (current_buffer().loading()) {
+                std::cout << "Not editable" << std::endl;
+                return;
+            }
+            current_buffer().save_snapshot();
             current_buffer().erase_selected();
             reset_to_normal_mode();
             return;
@@ -849,11 +922,12 @@ void Editor::finder_mode(Key key) {
             if (m_finder.mode() == FinderMode::Find) {
                 m_finder.set_to_highlight(true);
                 m_finder.find_in_content(current_buffer().rope());
+            } else if (current_buffer().loading()) {
+                std::cout << "Not editable" << std::endl;
             } else {
                 current_buffer().save_snapshot();
-                current_buffer().mark_dirty();
-                current_buffer().rope()
-                    = m_finder.replace_in_content(current_buffer().rope());
+                current_buffer().replace_content(
+                    m_finder.replace_in_content(current_buffer().rope()));
             }
 
             m_finder.toggle_prompt(FinderMode::None);
@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstring>
+#include <string>
 #include <vector>
 
 // void Finder::set_pattern(const Rope& pattern) { m_pattern = pattern; }
@@ -62,38 +63,54 @@ void Finder::find_in_content(const Rope& text) {
         return;
     }
 
-    Rope z_text = m_pattern.append("$").append(text);
-    std::size_t z_length = z_text.length();
-    std::vector<std::size_t> z(z_length, 0);
-    std::size_t l = 0, r = 0;
+    // Knuth-Morris-Pratt needs only one forward pass over the text, so the
+    // rope is read leaf by leaf instead of through per-character lookups.
+    const std::string pattern = m_pattern.to_string();
+    std::vector<std::size_t> prefix(pattern.size(), 0);
 
-    for (std::size_t i = 1; i < z_length; i++) {
-        if (i < r) {
-            z[i] = ((r - i) < z[i - l]) ? (r - i) : z[i - l];
+    for (std::size_t i = 1, k = 0; i < pattern.size(); ++i) {
+        while (k > 0 && pattern[i] != pattern[k]) {
+            k = prefix[k - 1];
         }
-        while (i + z[i] < z_length && z_text[z[i]] == z_text[i + z[i]]) {
-            ++z[i];
-        }
-        if (i + z[i] > r) {
-            l = i;
-            r = i + z[i];
+        if (pattern[i] == pattern[k]) {
+            ++k;
         }
+        prefix[i] = k;
     }
 
+    // A second iterator trails behind to the start of each match, tracking
+    // the line and column on the way.
     Cursor cursor{};
-    for (std::size_t i = m_pattern.length() + 1; i < z_length; i++) {
-        char c = z_text[i];
-        if (z[i] == m_pattern.length()) {
-            m_matches.push_back(cursor);
-            m_match_idx.push_back(i - m_pattern.length() - 1);
+    auto match_start = text.begin();
+    std::size_t matched = 0;
+    std::size_t index = 0;
+
+    for (char c : text) {
+        while (matched > 0 && c != pattern[matched]) {
+            matched = prefix[matched - 1];
+        }
+        if (c == pattern[matched]) {
+            ++matched;
         }
 
-        if (c == '\n') {
-            cursor.column = 0;
-            ++cursor.line;
-        } else {
-            ++cursor.column;
+        if (matched == pattern.size()) {
+            std::size_t start = index + 1 - pattern.size();
+
+            for (; match_start.index() < start; ++match_start) {
+                if (*match_start == '\n') {
+                    cursor.column = 0;
+                    ++cursor.line;
+                } else {
+                    ++cursor.column;
+                }
+            }
+
+            m_matches.push_back(cursor);
+            m_match_idx.push_back(start);
+            matched = prefix[matched - 1];
         }
+
+        ++index;
     }
 }
 
@@ -0,0 +1,212 @@
+#include "highlight/language.hpp"
+#include "highlight/lexer.hpp"
+#include "highlight/token.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Measures lexing throughput on synthetic C++, one line at a time as the
+// editor does, with the definition in data/languages. Run it from the
+// repository root. Usage: bench_lexer [size in MiB, default 64] [text]
+//
+// The text is `code`, the default, or `prose`: long comments and string
+// literals, where most bytes are skipped in runs.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// The fastest of this many runs is reported.
+constexpr std::size_t rounds = 5;
+
+constexpr std::array<std::string_view, 40> words = {{
+    "int",       "auto",     "const",     "return",   "if",
+    "else",      "for",      "while",     "void",     "unsigned",
+    "template",  "typename", "constexpr", "static",   "namespace",
+    "nullptr",   "true",     "std",       "size_t",   "string_view",
+    "vector",    "Buffer",   "m_pos",     "m_text",   "index",
+    "count",     "result",   "node",      "left",     "right",
+    "length",    "begin",    "end",       "value",    "make_text",
+    "0",         "42",       "0x7f",      "1'000'000", "3.14f",
+}};
+
+constexpr std::array<std::string_view, 24> punctuation = {{
+    "(", ")", "{", "}",  "[",  "]",  ";",  "::", "->", "<<", "==", "!=",
+    ".", ",", "=", "+=", "<",  ">",  "*",  "&",  "+",  "-",  "!",  "?",
+}};
+
+constexpr std::array<std::string_view, 6> lines = {{
+    "#include \"highlight/lexer.hpp\"",
+    "// Skips to the end of the line.",
+    "/* A block comment",
+    "   that spans lines. */",
+    "std::string_view text = \"hello, world\";",
+    "char c = '\\n';",
+}};
+
+constexpr std::array<std::string_view, 16> prose_words = {{
+    "the",   "buffer", "keeps", "a",     "rope",  "of",    "leaves",  "that",
+    "share", "text",   "with",  "every", "state", "undo",  "returns", "to",
+}};
+
+// Appends words until the line is about `length` bytes long.
+void append_prose(std::string& text, std::size_t length,
+                  std::mt19937_64& random) {
+    std::uniform_int_distribution<std::size_t> word{0,
+                                                    prose_words.size() - 1};
+    std::size_t end = text.size() + length;
+
+    while (text.size() < end) {
+        text += prose_words[word(random)];
+        text.push_back(' ');
+    }
+}
+
+std::string make_prose(std::size_t size) {
+    std::mt19937_64 random{42};
+    std::uniform_int_distribution<std::size_t> kind{0, 2};
+    std::uniform_int_distribution<std::size_t> length{60, 400};
+    std::uniform_int_distribution<std::size_t> lines{4, 40};
+
+    std::string text;
+    text.reserve(size + 512);
+
+    while (text.size() < size) {
+        switch (kind(random)) {
+        case 0:
+            text += "// ";
+            append_prose(text, length(random), random);
+            break;
+        case 1:
+            text += "/*";
+            for (std::size_t i = lines(random); i > 0; --i) {
+                text += "\n   ";
+                append_prose(text, 72, random);
+            }
+            text += "*/";
+            break;
+        default:
+            text += "auto text = \"";
+            append_prose(text, length(random), random);
+            text += "\";";
+            break;
+        }
+
+        text.push_back('\n');
+    }
+
+    return text;
+}
+
+std::string make_text(std::size_t size) {
+    std::mt19937_64 random{42};
+    std::uniform_int_distribution<std::size_t> word{0, words.size() - 1};
+    std::uniform_int_distribution<std::size_t> mark{0,
+                                                    punctuation.size() - 1};
+    std::uniform_int_distribution<std::size_t> line{0, lines.size() - 1};
+    std::uniform_int_distribution<std::size_t> indent{0, 3};
+    std::uniform_int_distribution<std::size_t> length{2, 12};
+    std::uniform_int_distribution<int> percent{0, 99};
+
+    std::string text;
+    text.reserve(size + 256);
+
+    while (text.size() < size) {
+        text.append(indent(random) * 4, ' ');
+
+        if (percent(random) < 15) {
+            text += lines[line(random)];
+        } else {
+            for (std::size_t i = length(random); i > 0; --i) {
+                text += words[word(random)];
+                text += percent(random) < 50 ? " " : "";
+                text += punctuation[mark(random)];
+            }
+        }
+
+        text.push_back('\n');
+    }
+
+    return text;
+}
+
+// Lexes `text` line by line, carrying the state over between lines, and
+// returns a checksum of the tokens.
+std::size_t lex(const Language& language, std::string_view text,
+               std::size_t& tokens) {
+    Lexer::State state{};
+    std::size_t checksum = 0;
+
+    for (std::size_t start = 0; start < text.size();) {
+        std::size_t end = text.find('\n', start);
+        end = end == std::string_view::npos ? text.size() : end;
+
+        Lexer lexer{language, text.substr(start, end - start), state};
+
+        for (Token token = lexer.next(); token.kind() != TokenKind::End;
+             token = lexer.next()) {
+            checksum += static_cast<std::size_t>(token.kind())
+                        + token.text().size();
+            ++tokens;
+        }
+
+        state = lexer.state();
+        start = end + 1;
+    }
+
+    return checksum;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const Language& language = Language::for_file("bench.cpp");
+
+    if (&language == &Language::plain()) {
+        std::cerr << "No definition for C++ in data/languages" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::size_t mebibytes
+        = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64;
+    std::string_view kind = argc > 2 ? argv[2] : "code";
+
+    if (kind != "code" && kind != "prose") {
+        std::cerr << "Unknown text " << kind << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string text = kind == "code" ? make_text(mebibytes * 1024 * 1024)
+                                      : make_prose(mebibytes * 1024 * 1024);
+    std::size_t tokens = 0;
+    std::size_t checksum = 0;
+    auto elapsed = Clock::duration::max();
+
+    for (std::size_t i = 0; i < rounds; ++i) {
+        tokens = 0;
+
+        auto start = Clock::now();
+        checksum = lex(language, text, tokens);
+        elapsed = std::min(elapsed, Clock::now() - start);
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    double bytes = static_cast<double>(text.size());
+
+    std::cout << mebibytes << " MiB of " << kind << ", " << tokens << " tokens, checksum "
+              << checksum << std::endl;
+    std::cout << std::fixed << std::setprecision(2) << std::setw(10)
+              << ns / bytes << " ns/byte" << std::endl;
+    std::cout << std::setw(10) << ns / static_cast<double>(tokens)
+              << " ns/token" << std::endl;
+    std::cout << std::setw(10) << bytes / ns * 1e3 << " MB/s" << std::endl;
+}
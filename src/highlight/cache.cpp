@@ -0,0 +1,118 @@
+#include "highlight/cache.hpp"
+
+#include "highlight/highlight.hpp"
+#include "highlight/language.hpp"
+#include "highlight/token.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+#include <utility>
+
+namespace {
+
+// Tabs are drawn as this many spaces.
+constexpr std::string_view tab = "        ";
+
+} // namespace
+
+const Language& HighlightCache::language() const { return *m_language; }
+
+void HighlightCache::set_language(const Language& language) {
+    if (&language != m_language) {
+        m_language = &language;
+        clear();
+    }
+}
+
+const HighlightCache::Line* HighlightCache::find(std::size_t index,
+                                                 std::size_t start,
+                                                 std::size_t length) const {
+    auto it = m_lines.find(index);
+
+    if (it == m_lines.end() || it->second.start != start
+        || it->second.length != length) {
+        return nullptr;
+    }
+
+    return &it->second;
+}
+
+const HighlightCache::Line& HighlightCache::insert(std::size_t index,
+                                                   std::size_t start,
+                                                   std::size_t end,
+                                                   std::string_view text,
+                                                   Lexer::State state) {
+    if (m_lines.size() >= max_lines) {
+        m_lines.clear();
+    }
+
+    Line line{start, text.size(), end};
+    line.text.reserve(text.size() * 2);
+
+    Highlighter highlighter(*m_language, text, state);
+
+    while (true) {
+        HighlightedToken token = highlighter.next();
+
+        if (token.token.kind() == TokenKind::End) {
+            break;
+        }
+
+        std::string_view token_text
+            = token.token.text() == "\t" ? tab : token.token.text();
+
+        line.spans.push_back(
+            {line.text.size(), token_text.size(), token.color});
+        line.text += token_text;
+        line.text += '\0';
+    }
+
+    return m_lines.insert_or_assign(index, std::move(line)).first->second;
+}
+
+void HighlightCache::edit(std::size_t position, std::size_t index,
+                          std::size_t removed_lines,
+                          std::size_t inserted_lines) {
+    invalidate(position);
+
+    // The states after the edited line move along with their lines.
+    if (index + 1 < m_states.size()) {
+        std::size_t after = m_states.size() - index - 1;
+        auto first = m_states.begin() + index + 1;
+        first = m_states.erase(first, first + std::min(removed_lines, after));
+        m_states.insert(first, inserted_lines, Lexer::State{});
+    }
+
+    std::size_t edited = index + inserted_lines;
+
+    // Edits that lexing has already gone past since no longer matter. That
+    // takes lexing the line after the last edited one, as the start state
+    // of that line is the first one the edit can have changed.
+    if (m_known > m_edited + 1) {
+        m_edited = edited;
+    } else if (m_edited > index + removed_lines) {
+        m_edited = std::max(m_edited - removed_lines + inserted_lines, edited);
+    } else {
+        m_edited = std::max(m_edited, edited);
+    }
+
+    m_known = std::min(m_known, index + 1);
+}
+
+void HighlightCache::invalidate(std::size_t position) {
+    // Lines end further along the text the later they come, so the ones to
+    // drop are all at the back.
+    while (!m_lines.empty()
+           && std::prev(m_lines.end())->second.end > position) {
+        m_lines.erase(std::prev(m_lines.end()));
+    }
+}
+
+void HighlightCache::clear() {
+    m_lines.clear();
+    m_states.clear();
+    m_known = 0;
+    m_edited = 0;
+}
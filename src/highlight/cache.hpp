@@ -0,0 +1,86 @@
+#pragma once
+
+#include "highlight/language.hpp"
+#include "highlight/lexer.hpp"
+
+#include "raylib.h"
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Highlighted text of the lines drawn recently, so that a frame in which
+// nothing changed neither lexes nor allocates. Lines are keyed by index and
+// remember the part of the text they were drawn from; edits drop every line
+// from the edited one on, since the lines after it may have moved.
+//
+// The cache also keeps the lexer state each line starts in, which depends
+// on every line before it. An edit only invalidates the states after the
+// edited lines, and those are lexed again lazily, stopping as soon as one
+// comes out as it was before: the rest of the file is then known to be
+// unaffected.
+class HighlightCache {
+public:
+    struct Span {
+        // Offset of the token in the line's text, where it is followed by a
+        // terminating null so it can be drawn in place.
+        std::size_t offset{};
+        // Width of the token in columns.
+        std::size_t length{};
+        Color color{};
+    };
+
+    struct Line {
+        std::size_t start{};
+        std::size_t length{};
+        // Where the next line starts, or just past the end of the text.
+        std::size_t end{};
+        std::string text{};
+        std::vector<Span> spans{};
+    };
+
+    const Language& language() const;
+    // Highlights the text as `language` from now on.
+    void set_language(const Language& language);
+
+    // The line `index`, if it was last highlighted from the `length` bytes
+    // at `start`.
+    const Line* find(std::size_t index, std::size_t start,
+                     std::size_t length) const;
+    // Highlights `text`, the `text.size()` bytes at `start` in line `index`,
+    // which ends at `end` and starts in `state`.
+    const Line& insert(std::size_t index, std::size_t start, std::size_t end,
+                       std::string_view text, Lexer::State state);
+
+    // The state line `index` starts in. `read(i)` returns the text of line
+    // `i`, and is called for the lines whose state is not known yet.
+    template<typename Reader>
+    Lexer::State state(std::size_t index, Reader&& read);
+
+    // Notes that the text at `position`, in line `index`, was replaced,
+    // removing `removed_lines` line feeds and inserting `inserted_lines`.
+    void edit(std::size_t position, std::size_t index,
+              std::size_t removed_lines, std::size_t inserted_lines);
+    // Drops the lines that reach `position` or beyond.
+    void invalidate(std::size_t position);
+    void clear();
+
+private:
+    // Scrolling through a long file would otherwise keep every line.
+    static constexpr std::size_t max_lines = 4096;
+
+    const Language* m_language{&Language::plain()};
+    std::map<std::size_t, Line> m_lines{};
+
+    // Start state of each line lexed so far. The first m_known are up to
+    // date; the rest were before the edits since, the last of which ended
+    // in line m_edited, and become so again once lexing past that line
+    // arrives at one of them.
+    std::vector<Lexer::State> m_states{};
+    std::size_t m_known{};
+    std::size_t m_edited{};
+};
+
+#include "highlight/cache_inl.hpp"
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "highlight/cache.hpp"
+
+#include "highlight/lexer.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+template<typename Reader>
+Lexer::State HighlightCache::state(std::size_t index, Reader&& read) {
+    if (m_states.empty()) {
+        m_states.emplace_back();
+    }
+    m_known = std::max<std::size_t>(m_known, 1);
+
+    while (m_known <= index) {
+        Lexer::State next = Lexer::end_state(*m_language, read(m_known - 1),
+                                             m_states[m_known - 1]);
+
+        if (m_known == m_states.size()) {
+            m_states.push_back(next);
+        } else if (m_known > m_edited && m_states[m_known] == next) {
+            m_known = m_states.size();
+            continue;
+        } else {
+            m_states[m_known] = next;
+        }
+
+        ++m_known;
+    }
+
+    return m_states[index];
+}
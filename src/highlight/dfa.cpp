@@ -0,0 +1,302 @@
+#include "highlight/dfa.hpp"
+
+#include "highlight/nfa.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using StateSet = std::vector<std::size_t>;
+
+// Adds the states reachable from `states` without reading a byte, and
+// sorts them so that equal sets compare equal.
+StateSet closure(const Nfa& nfa, StateSet states) {
+    std::vector<bool> seen(nfa.states().size());
+    StateSet stack = states;
+    states.clear();
+
+    while (!stack.empty()) {
+        std::size_t state = stack.back();
+        stack.pop_back();
+
+        if (seen[state]) {
+            continue;
+        }
+
+        seen[state] = true;
+        states.push_back(state);
+
+        for (std::size_t next : nfa.states()[state].epsilon) {
+            stack.push_back(next);
+        }
+    }
+
+    std::sort(states.begin(), states.end());
+    return states;
+}
+
+// The automaton as the subset construction leaves it, before equivalent
+// states are merged.
+struct Subsets {
+    std::vector<std::vector<std::size_t>> next{};
+    std::vector<std::vector<std::uint32_t>> accepts{};
+};
+
+} // namespace
+
+Dfa::Dfa() : Dfa(Nfa{}) {}
+
+Dfa::Dfa(const Nfa& nfa) {
+    // Splits the bytes into classes by every set a transition reads, so
+    // that bytes in the same class lead to the same states everywhere.
+    std::size_t class_count = 1;
+
+    for (const auto& state : nfa.states()) {
+        if (state.next == Nfa::none) {
+            continue;
+        }
+
+        std::array<int, 512> split;
+        split.fill(-1);
+        std::array<std::uint8_t, 256> classes{};
+        std::size_t count = 0;
+
+        for (std::size_t b = 0; b < classes.size(); ++b) {
+            int& id = split[m_classes[b] * 2 + state.bytes[b]];
+
+            if (id < 0) {
+                id = static_cast<int>(count++);
+            }
+            classes[b] = static_cast<std::uint8_t>(id);
+        }
+
+        m_classes = classes;
+        class_count = count;
+    }
+
+    m_class_count = class_count;
+    std::vector<unsigned char> representatives(class_count);
+
+    for (std::size_t b = m_classes.size(); b-- > 0;) {
+        representatives[m_classes[b]] = static_cast<unsigned char>(b);
+    }
+
+    // Subset construction, with the empty set as the dead state.
+    Subsets subsets;
+    std::vector<StateSet> sets{{}, closure(nfa, {Nfa::start})};
+    std::map<StateSet, std::size_t> ids{{sets[0], 0}, {sets[1], 1}};
+
+    for (std::size_t id = 0; id < sets.size(); ++id) {
+        std::vector<std::uint32_t> accepts;
+
+        for (std::size_t state : sets[id]) {
+            if (nfa.states()[state].rule != Nfa::none) {
+                accepts.push_back(
+                    static_cast<std::uint32_t>(nfa.states()[state].rule));
+            }
+        }
+
+        std::sort(accepts.begin(), accepts.end());
+
+        // Once a rule matches whatever follows, the rules after it never
+        // win.
+        auto last = std::find_if(accepts.begin(), accepts.end(),
+                                 [&](std::uint32_t rule) {
+                                     return nfa.follow(rule).all();
+                                 });
+        accepts.erase(last == accepts.end() ? last : last + 1,
+                      accepts.end());
+        subsets.accepts.push_back(std::move(accepts));
+
+        std::vector<std::size_t> next(class_count);
+
+        for (std::size_t c = 0; c < class_count; ++c) {
+            StateSet targets;
+
+            for (std::size_t state : sets[id]) {
+                const auto& from = nfa.states()[state];
+
+                if (from.next != Nfa::none && from.bytes[representatives[c]]) {
+                    targets.push_back(from.next);
+                }
+            }
+
+            targets = closure(nfa, std::move(targets));
+            auto [it, inserted] = ids.try_emplace(targets, sets.size());
+
+            if (inserted) {
+                sets.push_back(std::move(targets));
+            }
+            next[c] = it->second;
+        }
+
+        subsets.next.push_back(std::move(next));
+    }
+
+    // Moore's algorithm: states start out apart if they accept different
+    // rules, and are split further for as long as some byte takes them to
+    // different blocks. The start state is kept apart so that it keeps its
+    // number.
+    std::size_t count = sets.size();
+    std::vector<std::size_t> block(count);
+    std::size_t block_count = 0;
+
+    {
+        std::map<std::pair<std::vector<std::uint32_t>, bool>, std::size_t>
+            keys;
+
+        for (std::size_t s = 0; s < count; ++s) {
+            auto key = std::make_pair(subsets.accepts[s], s == start);
+            auto [it, inserted] = keys.try_emplace(key, keys.size());
+            block[s] = it->second;
+        }
+
+        block_count = keys.size();
+    }
+
+    while (true) {
+        std::map<std::vector<std::size_t>, std::size_t> signatures;
+        std::vector<std::size_t> refined(count);
+
+        for (std::size_t s = 0; s < count; ++s) {
+            std::vector<std::size_t> signature{block[s]};
+
+            for (std::size_t next : subsets.next[s]) {
+                signature.push_back(block[next]);
+            }
+
+            auto [it, inserted]
+                = signatures.try_emplace(signature, signatures.size());
+            refined[s] = it->second;
+        }
+
+        block = std::move(refined);
+
+        if (signatures.size() == block_count) {
+            break;
+        }
+        block_count = signatures.size();
+    }
+
+    if (block_count > std::numeric_limits<StateId>::max()) {
+        throw std::runtime_error{"Too many states in lexer automaton"};
+    }
+
+    // Renumbers the blocks so that the dead and start states come first,
+    // and the accepting states last.
+    std::vector<std::size_t> number(block_count, none);
+    std::vector<std::size_t> members{dead};
+    number[block[dead]] = dead;
+    number[block[start]] = start;
+    members.push_back(start);
+
+    for (bool accepting : {false, true}) {
+        if (accepting) {
+            m_first_accepting = static_cast<StateId>(members.size());
+        }
+
+        for (std::size_t s = 0; s < count; ++s) {
+            if (number[block[s]] == none
+                && subsets.accepts[s].empty() != accepting) {
+                number[block[s]] = members.size();
+                members.push_back(s);
+            }
+        }
+    }
+
+    std::size_t state_count = members.size();
+    m_table.resize(state_count * class_count);
+    m_accept_offsets.push_back(0);
+
+    for (std::size_t id = 0; id < state_count; ++id) {
+        std::size_t s = members[id];
+
+        for (std::size_t c = 0; c < class_count; ++c) {
+            m_table[id * class_count + c]
+                = static_cast<StateId>(number[block[subsets.next[s][c]]]);
+        }
+
+        m_accepts.insert(m_accepts.end(), subsets.accepts[s].begin(),
+                         subsets.accepts[s].end());
+        m_accept_offsets.push_back(
+            static_cast<std::uint32_t>(m_accepts.size()));
+
+        const auto& accepts = subsets.accepts[s];
+        m_accepted.push_back(!accepts.empty() && nfa.follow(accepts[0]).all()
+                                 ? accepts[0]
+                                 : none);
+    }
+
+    for (std::size_t rule = 0; rule < nfa.rule_count(); ++rule) {
+        m_follow.push_back(nfa.follow(rule));
+    }
+
+    for (std::size_t s = 0; s < state_count; ++s) {
+        std::array<bool, 256> stays{};
+        std::size_t stay_count = 0;
+
+        for (std::size_t b = 0; b < stays.size(); ++b) {
+            stays[b] = next(static_cast<StateId>(s), static_cast<char>(b)) == s;
+            stay_count += stays[b];
+        }
+
+        std::size_t loop = none;
+
+        if (s != dead
+            && (stays.size() - stay_count <= ByteSet::max_exits
+                || stay_count >= min_stays)) {
+            loop = m_runs.size();
+            m_runs.emplace_back(stays);
+        }
+
+        m_loops.push_back(loop);
+    }
+
+    // A state can still match what any state it leads to can.
+    m_pending.assign(state_count, none);
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (std::size_t s = 0; s < state_count; ++s) {
+            std::size_t pending = m_pending[s];
+
+            if (accepting(static_cast<StateId>(s))) {
+                pending = std::min<std::size_t>(
+                    pending, m_accepts[m_accept_offsets[s]]);
+            }
+            for (std::size_t c = 0; c < class_count; ++c) {
+                pending = std::min(pending,
+                                   m_pending[m_table[s * class_count + c]]);
+            }
+
+            if (pending != m_pending[s]) {
+                m_pending[s] = pending;
+                changed = true;
+            }
+        }
+    }
+}
+
+std::size_t Dfa::accept_followed(StateId state, int follow) const {
+    for (std::uint32_t i = m_accept_offsets[state];
+         i < m_accept_offsets[state + 1]; ++i) {
+        const Nfa::Bytes& bytes = m_follow[m_accepts[i]];
+
+        if (follow < 0 ? bytes.all() : bytes[follow]) {
+            return m_accepts[i];
+        }
+    }
+
+    return none;
+}
+
+std::size_t Dfa::state_count() const { return m_pending.size(); }
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "highlight/nfa.hpp"
+#include "highlight/scan.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// The minimal deterministic automaton for the rules of an Nfa, as a flat
+// transition table. Bytes that no pattern tells apart share a column.
+class Dfa {
+public:
+    using StateId = std::uint16_t;
+
+    // Where every transition ends once no rule can match any more.
+    static constexpr StateId dead = 0;
+    static constexpr StateId start = 1;
+    static constexpr std::size_t none = Nfa::none;
+
+    Dfa();
+    // Throws std::runtime_error if the automaton grows too large.
+    explicit Dfa(const Nfa& nfa);
+
+    StateId next(StateId state, char byte) const {
+        return m_table[state * m_class_count
+                       + m_classes[static_cast<unsigned char>(byte)]];
+    }
+
+    bool accepting(StateId state) const { return state >= m_first_accepting; }
+
+    // The rule matched on reaching `state`, when the match is followed by
+    // `follow`, or by nothing if it is negative. None if every rule the
+    // state accepts needs some other byte to follow.
+    std::size_t accept(StateId state, int follow) const {
+        std::size_t rule = m_accepted[state];
+        return rule != none ? rule : accept_followed(state, follow);
+    }
+
+    // True if runs of bytes that lead from `state` back to itself, as in
+    // a comment or a name, are worth skipping in one go.
+    bool loops(StateId state) const { return m_loops[state] != none; }
+    // The position of the first byte in `text`, from `pos` on, that leaves
+    // `state`, which loops; or the end of the text if none does.
+    std::size_t skip(StateId state, std::string_view text,
+                     std::size_t pos) const {
+        return m_runs[m_loops[state]].span(text, pos);
+    }
+
+    // The first rule that may still match from `state`, or none.
+    std::size_t pending(StateId state) const { return m_pending[state]; }
+
+    std::size_t state_count() const;
+
+private:
+    // States are skipped through if only a few bytes leave them, or if it
+    // takes many bytes to stay in them.
+    static constexpr std::size_t min_stays = 16;
+
+    std::array<std::uint8_t, 256> m_classes{};
+    std::size_t m_class_count{};
+    std::vector<StateId> m_table{};
+    StateId m_first_accepting{};
+
+    // The rules each state accepts, first rule first, up to the first one
+    // that needs no particular byte to follow: those of state `s` are
+    // m_accepts[m_accept_offsets[s]] up to m_accepts[m_accept_offsets[s +
+    // 1]].
+    std::vector<std::uint32_t> m_accept_offsets{};
+    std::vector<std::uint32_t> m_accepts{};
+    std::vector<Nfa::Bytes> m_follow{};
+    // The rule each state accepts whatever follows, if it comes first.
+    std::vector<std::size_t> m_accepted{};
+
+    std::vector<std::size_t> m_pending{};
+    // The index in m_runs of the bytes that keep to each state, or none.
+    std::vector<std::size_t> m_loops{};
+    std::vector<ByteSet> m_runs{};
+
+    std::size_t accept_followed(StateId state, int follow) const;
+};
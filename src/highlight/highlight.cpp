@@ -1,9 +1,15 @@
 #include "highlight/highlight.hpp"
 
+#include "highlight/language.hpp"
 #include "highlight/lexer.hpp"
 #include "highlight/token.hpp"
 
-Highlighter::Highlighter(std::string_view text) : m_lexer{text} {}
+Highlighter::Highlighter(const Language& language, std::string_view text)
+    : m_lexer{language, text} {}
+
+Highlighter::Highlighter(const Language& language, std::string_view text,
+                         Lexer::State state)
+    : m_lexer{language, text, state} {}
 
 HighlightedToken Highlighter::next() {
     Token token = m_lexer.next();
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "highlight/language.hpp"
 #include "highlight/lexer.hpp"
 #include "highlight/token.hpp"
 
@@ -7,7 +8,9 @@
 
 class Highlighter {
 public:
-    Highlighter(std::string_view text);
+    Highlighter(const Language& language, std::string_view text);
+    Highlighter(const Language& language, std::string_view text,
+                Lexer::State state);
 
     HighlightedToken next();
 
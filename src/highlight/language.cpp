@@ -0,0 +1,171 @@
+#include "highlight/language.hpp"
+
+#include "highlight/dfa.hpp"
+#include "highlight/nfa.hpp"
+#include "highlight/token.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+constexpr std::string_view directory = "data/languages";
+constexpr std::string_view blanks = " \t\r";
+
+std::string_view trim(std::string_view text) {
+    std::size_t first = text.find_first_not_of(blanks);
+
+    if (first == std::string_view::npos) {
+        return {};
+    }
+
+    return text.substr(first, text.find_last_not_of(blanks) + 1 - first);
+}
+
+// Splits the first word off `line`.
+std::string_view take_word(std::string_view& line) {
+    std::size_t end = std::min(line.find_first_of(blanks), line.size());
+    std::string_view word = line.substr(0, end);
+
+    line = trim(line.substr(end));
+    return word;
+}
+
+TokenKind parse_kind(std::string_view name) {
+    // Rules cannot make tokens that end the text.
+    auto it = std::find(kind_names.begin() + 1, kind_names.end(), name);
+
+    if (it == kind_names.end()) {
+        throw std::runtime_error{"Unknown token kind `" + std::string{name}
+                                 + "`"};
+    }
+
+    return static_cast<TokenKind>(it - kind_names.begin());
+}
+
+// Every definition in the data directory, in order of file name. Those
+// that fail to load are reported and left out.
+std::vector<Language> load_all() {
+    std::vector<std::filesystem::path> paths;
+    std::error_code error;
+
+    for (std::filesystem::directory_iterator it{directory, error};
+         !error && it != std::filesystem::directory_iterator{};
+         it.increment(error)) {
+        if (it->path().extension() == ".lang") {
+            paths.push_back(it->path());
+        }
+    }
+
+    std::sort(paths.begin(), paths.end());
+    std::vector<Language> languages;
+
+    for (const auto& path : paths) {
+        try {
+            languages.push_back(Language::load(path));
+        } catch (const std::runtime_error& error) {
+            std::cerr << error.what() << "\n";
+        }
+    }
+
+    return languages;
+}
+
+} // namespace
+
+Language::Language() = default;
+
+Language Language::load(const std::filesystem::path& path) {
+    std::ifstream file{path};
+
+    if (!file) {
+        throw std::runtime_error{"Could not open " + path.string()};
+    }
+
+    Language language;
+    language.m_name = path.stem().string();
+
+    Nfa nfa;
+    std::string line;
+
+    for (std::size_t number = 1; std::getline(file, line); ++number) {
+        std::string_view rest = trim(line);
+
+        if (rest.empty() || rest.front() == '#') {
+            continue;
+        }
+
+        try {
+            std::string_view directive = take_word(rest);
+
+            if (directive == "name") {
+                language.m_name = rest;
+            } else if (directive == "extensions") {
+                while (!rest.empty()) {
+                    language.m_extensions.emplace_back(take_word(rest));
+                }
+            } else if (directive == "words") {
+                TokenKind kind = parse_kind(take_word(rest));
+
+                while (!rest.empty()) {
+                    nfa.add_literal(take_word(rest));
+                    language.m_rules.push_back({kind});
+                }
+            } else if (directive == "rule" || directive == "raw") {
+                TokenKind kind = parse_kind(take_word(rest));
+
+                nfa.add_pattern(rest);
+                language.m_rules.push_back({kind, directive == "raw"});
+            } else {
+                throw std::runtime_error{"Unknown directive `"
+                                         + std::string{directive} + "`"};
+            }
+        } catch (const std::runtime_error& error) {
+            throw std::runtime_error{path.string() + ":"
+                                     + std::to_string(number) + ": "
+                                     + error.what()};
+        }
+    }
+
+    language.m_dfa = Dfa{nfa};
+    return language;
+}
+
+const Language& Language::for_file(std::string_view filename) {
+    static const std::vector<Language> languages = load_all();
+
+    for (const auto& language : languages) {
+        if (language.matches(filename)) {
+            return language;
+        }
+    }
+
+    return plain();
+}
+
+const Language& Language::plain() {
+    static const Language language;
+    return language;
+}
+
+const std::string& Language::name() const { return m_name; }
+
+bool Language::matches(std::string_view filename) const {
+    std::size_t dot = filename.rfind('.');
+
+    if (dot == std::string_view::npos) {
+        return false;
+    }
+
+    return std::find(m_extensions.begin(), m_extensions.end(),
+                     filename.substr(dot + 1))
+        != m_extensions.end();
+}
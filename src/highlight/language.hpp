@@ -0,0 +1,67 @@
+#pragma once
+
+#include "highlight/dfa.hpp"
+#include "highlight/token.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The highlighting rules of a language, read from a definition file in
+// data/languages and compiled into a DFA.
+//
+// A definition is a list of directives, one per line, with `#` starting a
+// comment line:
+//
+//     name cpp
+//     extensions cpp hpp h
+//     words keyword if else while
+//     rule comment //.*
+//     raw string R"
+//
+// `words` adds a rule for each of the words, and `rule` one for the
+// pattern making up the rest of the line, with the syntax described in
+// nfa.hpp. All of them give the kind of the tokens they match by its name
+// in kind_names. The lexer takes the longest match, and of rules matching
+// the same text, the first one in the file.
+//
+// `raw` adds a rule like `rule` for the opening of a raw string as in C++,
+// up to its quote. The token then goes on through a delimiter of up to
+// Lexer::State::max_delimiter bytes and a `(`, to the first `)` followed
+// by the same delimiter and a `"`, across lines if need be. No DFA can
+// match the delimiter a second time, so the lexer does that part itself.
+class Language {
+public:
+    // Plain text, with no rules.
+    Language();
+
+    // Reads and compiles the definition at `path`, throwing
+    // std::runtime_error if it is malformed.
+    static Language load(const std::filesystem::path& path);
+    // The language of the file, by its extension, among those defined in
+    // data/languages, or plain text if there is none.
+    static const Language& for_file(std::string_view filename);
+    static const Language& plain();
+
+    const std::string& name() const;
+    bool matches(std::string_view filename) const;
+
+    const Dfa& dfa() const { return m_dfa; }
+    TokenKind kind(std::size_t rule) const { return m_rules[rule].kind; }
+    // Whether `rule` matches the opening of a raw string.
+    bool raw(std::size_t rule) const { return m_rules[rule].raw; }
+
+private:
+    struct Rule {
+        // The kind of the tokens the rule matches.
+        TokenKind kind{};
+        bool raw{};
+    };
+
+    std::string m_name{"text"};
+    std::vector<std::string> m_extensions{};
+    std::vector<Rule> m_rules{};
+    Dfa m_dfa{};
+};
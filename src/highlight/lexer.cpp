@@ -1,282 +1,244 @@
 #include "highlight/lexer.hpp"
 
+#include "highlight/dfa.hpp"
+#include "highlight/language.hpp"
 #include "highlight/token.hpp"
-#include "utils.hpp"
 
-#include <array>
-#include <cctype>
+#include <algorithm>
+#include <cstddef>
 #include <string_view>
+#include <tuple>
+#include <utility>
 
-constexpr std::array<LiteralToken, 41> literal_tokens = {{
-    {"(", TokenKind::OpenParen},  {")", TokenKind::CloseParen},
-    {"{", TokenKind::OpenCurly},  {"}", TokenKind::CloseCurly},
-    {"[", TokenKind::OpenSquare}, {"]", TokenKind::CloseSquare},
-    {";", TokenKind::Semicolon},  {"[[", TokenKind::OpenAttr},
-    {"]]", TokenKind::CloseAttr}, {"->", TokenKind::Operator},
-    {"::", TokenKind::Operator},  {"<<", TokenKind::Operator},
-    {">>", TokenKind::Operator},  {"+=", TokenKind::Operator},
-    {"-=", TokenKind::Operator},  {"*=", TokenKind::Operator},
-    {"/=", TokenKind::Operator},  {"%=", TokenKind::Operator},
-    {"<=", TokenKind::Operator},  {">=", TokenKind::Operator},
-    {"!=", TokenKind::Operator},  {"&=", TokenKind::Operator},
-    {"~=", TokenKind::Operator},  {"^=", TokenKind::Operator},
-    {"==", TokenKind::Operator},  {".", TokenKind::Operator},
-    {",", TokenKind::Operator},   {"?", TokenKind::Operator},
-    {":", TokenKind::Operator},   {"+", TokenKind::Operator},
-    {"-", TokenKind::Operator},   {"*", TokenKind::Operator},
-    {"/", TokenKind::Operator},   {"%", TokenKind::Operator},
-    {"<", TokenKind::Operator},   {">", TokenKind::Operator},
-    {"!", TokenKind::Operator},   {"&", TokenKind::Operator},
-    {"~", TokenKind::Operator},   {"^", TokenKind::Operator},
-    {"=", TokenKind::Operator},
-}};
-
-constexpr std::array<std::string_view, 14> types = {{
-    "bool",
-    "char",
-    "float",
-    "double",
-    "int",
-    "long",
-    "short",
-    "signed",
-    "unsigned",
-    "void",
-    "char16_t",
-    "char32_t",
-    "char8_t",
-    "wchar_t",
-}};
-
-constexpr std::array<std::string_view, 84> keywords = {{
-    "auto",
-    "break",
-    "case",
-    "const",
-    "continue",
-    "default",
-    "do",
-    "else",
-    "enum",
-    "extern",
-    "for",
-    "goto",
-    "if",
-    "register",
-    "return",
-    "sizeof",
-    "static",
-    "struct",
-    "switch",
-    "typedef",
-    "union",
-    "volatile",
-    "while",
-    "alignas",
-    "alignof",
-    "and",
-    "and_eq",
-    "asm",
-    "atomic_cancel",
-    "atomic_commit",
-    "atomic_noexcept",
-    "bitand",
-    "bitor",
-    "catch",
-    "class",
-    "co_await",
-    "co_return",
-    "co_yield",
-    "compl",
-    "concept",
-    "const_cast",
-    "consteval",
-    "constexpr",
-    "constinit",
-    "decltype",
-    "delete",
-    "dynamic_cast",
-    "explicit",
-    "export",
-    "false",
-    "friend",
-    "inline",
-    "mutable",
-    "namespace",
-    "new",
-    "nodiscard",
-    "noexcept",
-    "not",
-    "not_eq",
-    "nullptr",
-    "operator",
-    "or",
-    "or_eq",
-    "private",
-    "protected",
-    "public",
-    "reflexpr",
-    "reinterpret_cast",
-    "requires",
-    "static_assert",
-    "static_cast",
-    "synchronized",
-    "template",
-    "this",
-    "thread_local",
-    "throw",
-    "true",
-    "try",
-    "typeid",
-    "typename",
-    "using",
-    "virtual",
-    "xor",
-    "xor_eq",
-}};
-
-Lexer::Lexer(std::string_view text) : m_text{text} {};
-
-bool Lexer::starts_with(std::string_view prefix) const {
-    return m_text.substr(m_pos).starts_with(prefix);
-}
+Lexer::Lexer(const Language& language, std::string_view text)
+    : m_language{&language}, m_text{text} {};
+
+Lexer::Lexer(const Language& language, std::string_view text, State state)
+    : m_language{&language}, m_text{text}, m_state{state} {};
 
-void Lexer::skip(std::size_t n) { m_pos += n; }
+Lexer::State Lexer::state() const { return m_state; }
 
-void Lexer::trim_left() {
-    while (m_pos < m_text.size() && std::isspace(m_text[m_pos])) {
-        skip(1);
+Lexer::State Lexer::end_state(const Language& language, std::string_view text,
+                              State state) {
+    Lexer lexer{language, text, state};
+
+    while (lexer.next().kind() != TokenKind::End) {
     }
+
+    return lexer.state();
 }
 
 Token Lexer::next() {
-    Token token;
-    token.set_text(m_text.substr(m_pos)).set_kind(TokenKind::End);
-    std::size_t old_pos = m_pos;
-
-    if (m_pos >= m_text.size()) {
-        return token;
+    if (m_pos == 0 && m_state.raw != Dfa::none) {
+        return resume_raw();
     }
 
-    if (m_text[m_pos] == '"') {
-        token.set_kind(TokenKind::String);
-        skip(1);
+    const Dfa& dfa = m_language->dfa();
+    std::size_t start = m_pos;
+    bool resumed = start == 0 && m_state.dfa != Dfa::dead;
+    Dfa::StateId first = resumed ? m_state.dfa : Dfa::start;
+    Dfa::StateId state = first;
 
-        while (m_pos < m_text.size() && m_text[m_pos] != '"'
-               && m_text[m_pos] != '\n') {
-            skip(1);
+    // The longest match so far, and the state it ended in.
+    std::size_t end = start;
+    Dfa::StateId matched = Dfa::dead;
+    std::size_t pos = start;
+    State after{};
+
+    for (; pos < m_text.size(); ++pos) {
+        Dfa::StateId next = dfa.next(state, m_text[pos]);
+
+        if (next == Dfa::dead) {
+            break;
         }
 
-        if (m_pos < m_text.size()) {
-            skip(1);
+        // Runs of bytes that keep to the same state, such as the text of
+        // a comment, are skipped in one go.
+        if (next == state && dfa.loops(state)) {
+            pos = dfa.skip(state, m_text, pos + 1) - 1;
         }
 
-        token.set_text(m_text.substr(old_pos, m_pos - old_pos));
-        return token;
+        state = next;
+
+        if (dfa.accepting(state)) {
+            matched = state;
+            end = pos + 1;
+        }
     }
 
-    if (m_text[m_pos] == '\'') {
-        token.set_kind(TokenKind::Char);
-        skip(1);
+    std::size_t rule = Dfa::none;
 
-        while (m_pos < m_text.size() && m_text[m_pos] != '\''
-               && m_text[m_pos] != '\n') {
-            skip(1);
-        }
+    if (matched != Dfa::dead) {
+        rule = dfa.accept(matched, follow(end));
 
-        if (m_pos < m_text.size()) {
-            skip(1);
+        // Only rules that need some other byte to follow could have
+        // matched, so the match is shorter.
+        if (rule == Dfa::none) {
+            std::tie(end, rule) = match(first, end - 1);
         }
+    }
 
-        token.set_text(m_text.substr(old_pos, m_pos - old_pos));
-        return token;
+    // A token left open by the previous line goes on for as long as it
+    // still matches, even if it never ends.
+    if (resumed && end == start) {
+        rule = dfa.pending(state);
+        end = pos;
     }
 
-    if (m_text[m_pos] == '#') {
-        token.set_kind(TokenKind::Preproc);
-        while (m_pos < m_text.size() && m_text[m_pos] != '\n') {
-            skip(1);
-        }
-        if (m_pos < m_text.size()) {
-            skip(1);
+    // So does one that reaches the end of the text and could go on past a
+    // line feed; the next line carries on with it.
+    if (pos == m_text.size() && state != Dfa::start) {
+        if (Dfa::StateId next = dfa.next(state, '\n'); next != Dfa::dead) {
+            after = {next};
+            rule = dfa.pending(state);
+            end = pos;
         }
+    }
 
-        token.set_text(m_text.substr(old_pos, m_pos - old_pos));
-        return token;
+    // The DFA only matches the opening of a raw string; the rest depends on
+    // its delimiter.
+    if (end > start && rule != Dfa::none && m_language->raw(rule)) {
+        end = raw_string(rule, end, after);
     }
 
-    if (starts_with("//")) {
-        token.set_kind(TokenKind::Comment);
+    Token token;
+
+    if (end == start) {
+        if (start >= m_text.size()) {
+            if (resumed) {
+                m_state = after;
+            }
 
-        while (m_pos < m_text.size() && m_text[m_pos] != '\n') {
-            skip(1);
+            token.set_kind(TokenKind::End).set_text(m_text.substr(start));
+            return token;
         }
-        if (m_pos < m_text.size()) {
-            skip(1);
+
+        // Nothing of the open token is left on this line after all.
+        if (resumed) {
+            m_state = {};
+            return next();
         }
 
-        token.set_text(m_text.substr(old_pos, m_pos - old_pos));
-        return token;
+        token.set_kind(TokenKind::Invalid);
+        end = start + 1;
+    } else {
+        token.set_kind(m_language->kind(rule));
     }
 
-    for (const auto& [text, token_kind] : literal_tokens) {
-        if (starts_with(text)) {
-            token.set_kind(token_kind);
-            token.set_text(text);
-            skip(text.size());
-            return token;
-        }
+    m_pos = end;
+    m_state = after;
+    token.set_text(m_text.substr(start, end - start));
+    return token;
+}
+
+int Lexer::follow(std::size_t pos) const {
+    return pos < m_text.size() ? static_cast<unsigned char>(m_text[pos]) : -1;
+}
+
+// Continues a raw string left open by the previous line, up to where it is
+// closed or else the end of the line.
+Token Lexer::resume_raw() {
+    Token token;
+    token.set_kind(m_language->kind(m_state.raw));
+    std::size_t end = raw_string_end(m_state, 0);
+
+    if (end == std::string_view::npos) {
+        end = m_text.size();
+    } else {
+        m_state = {};
+    }
+
+    if (end == 0) {
+        token.set_kind(TokenKind::End).set_text(m_text);
+        return token;
     }
 
-    if (utils::is_symbol_start(m_text[m_pos])) {
-        token.set_kind(TokenKind::Symbol);
+    m_pos = end;
+    token.set_text(m_text.substr(0, end));
+    return token;
+}
 
-        while (m_pos < m_text.size() && utils::is_symbol(m_text[m_pos])) {
-            skip(1);
+// The end of the raw string whose opening, matched by `rule`, ends at
+// `pos`. A string that is still open at the end of the text leaves its
+// rule and delimiter in `after`. Without a valid delimiter and `(`, only
+// the opening makes the token.
+std::size_t Lexer::raw_string(std::size_t rule, std::size_t pos,
+                              State& after) const {
+    std::size_t limit
+        = std::min(m_text.size(), pos + State::max_delimiter + 1);
+    std::size_t open = pos;
+
+    for (; open < limit && m_text[open] != '('; ++open) {
+        switch (m_text[open]) {
+        case ' ':
+        case ')':
+        case '\\':
+        case '"':
+        case '\t':
+        case '\v':
+        case '\f':
+        case '\r':
+        case '\n':
+            return pos;
         }
+    }
 
-        auto len = m_pos - old_pos;
-        auto symbol = m_text.substr(old_pos, len);
-        token.set_text(symbol);
+    if (open == limit) {
+        return pos;
+    }
 
-        if (std::toupper(m_text[old_pos]) == m_text[old_pos]) {
-            token.set_kind(TokenKind::Type);
-        }
+    State raw{.raw = rule,
+              .delimiter_length = static_cast<std::uint8_t>(open - pos)};
+    std::copy(m_text.begin() + pos, m_text.begin() + open,
+              raw.delimiter.begin());
 
-        for (auto type : types) {
-            if (len == type.size() && type == symbol) {
-                token.set_kind(TokenKind::Type);
-                break;
-            }
-        }
+    std::size_t end = raw_string_end(raw, open + 1);
 
-        for (auto keyword : keywords) {
-            if (len == keyword.size() && keyword == symbol) {
-                token.set_kind(TokenKind::Keyword);
-                break;
-            }
-        }
+    if (end == std::string_view::npos) {
+        after = raw;
+        return m_text.size();
+    }
 
-        if (m_pos + 1 < m_text.size() && m_text[m_pos] == '(') {
-            token.set_kind(TokenKind::Function);
-        }
+    return end;
+}
 
-        return token;
-    } else if (std::isdigit(m_text[m_pos])) {
-        token.set_kind(TokenKind::Number);
+// The end of the first `)` from `pos` on that is followed by the delimiter
+// of `state` and a `"`, or npos if there is none.
+std::size_t Lexer::raw_string_end(const State& state, std::size_t pos) const {
+    std::string_view delimiter{state.delimiter.data(),
+                               state.delimiter_length};
 
-        while (m_pos < m_text.size() && utils::is_symbol(m_text[m_pos])) {
-            skip(1);
+    for (pos = m_text.find(')', pos); pos != std::string_view::npos;
+         pos = m_text.find(')', pos + 1)) {
+        std::string_view rest = m_text.substr(pos + 1);
+
+        if (rest.starts_with(delimiter)
+            && rest.substr(delimiter.size()).starts_with('"')) {
+            return pos + delimiter.size() + 2;
         }
+    }
 
-        auto len = m_pos - old_pos;
-        auto symbol = m_text.substr(old_pos, len);
-        token.set_text(symbol);
+    return std::string_view::npos;
+}
 
-        return token;
+// The end and rule of the longest match from the current position, in
+// `state`, that ends no later than `limit`, checking every rule as it is
+// reached rather than only the last.
+std::pair<std::size_t, std::size_t> Lexer::match(Dfa::StateId state,
+                                                 std::size_t limit) const {
+    const Dfa& dfa = m_language->dfa();
+    std::size_t end = m_pos;
+    std::size_t rule = Dfa::none;
+
+    for (std::size_t pos = m_pos; pos < limit; ++pos) {
+        state = dfa.next(state, m_text[pos]);
+
+        if (std::size_t accepted = dfa.accept(state, follow(pos + 1));
+            accepted != Dfa::none) {
+            end = pos + 1;
+            rule = accepted;
+        }
     }
 
-    skip(1);
-    token.set_kind(TokenKind::Invalid).set_text(m_text.substr(old_pos, 1));
-    return token;
-}
\ No newline at end of file
+    return {end, rule};
+}
@@ -1,20 +1,61 @@
 #pragma once
 
+#include "highlight/dfa.hpp"
+#include "highlight/language.hpp"
 #include "highlight/token.hpp"
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
 #include <string_view>
+#include <utility>
 
+// Splits text into tokens by running the DFA of a language over it, each
+// token being the longest match of any of its rules. Bytes no rule matches
+// make tokens of their own, of kind Invalid.
 class Lexer {
 public:
-    Lexer(std::string_view text);
+    // What the text being lexed starts inside of. Tokens such as block
+    // comments run on past the end of a line, so lexing a line needs the
+    // state the previous one ended in.
+    struct State {
+        static constexpr std::size_t max_delimiter = 16;
+
+        // The DFA state a token left open by the previous line is in, past
+        // its line feed, or dead if the line starts between tokens.
+        Dfa::StateId dfa{Dfa::dead};
+        // The rule of a raw string left open by the previous line, or none,
+        // and the delimiter that closes it.
+        std::size_t raw{Dfa::none};
+        std::uint8_t delimiter_length{};
+        std::array<char, max_delimiter> delimiter{};
+
+        bool operator==(const State& other) const = default;
+    };
+
+    Lexer(const Language& language, std::string_view text);
+    Lexer(const Language& language, std::string_view text, State state);
     Token next();
 
+    // The state at the point reached so far; once every token has been
+    // read, the state the next line starts in.
+    State state() const;
+    // The state a line of `text` that starts in `state` ends in.
+    static State end_state(const Language& language, std::string_view text,
+                           State state);
+
 private:
+    const Language* m_language;
     std::string_view m_text;
     std::size_t m_pos{};
+    State m_state{};
 
-    bool starts_with(std::string_view prefix) const;
-    void skip(std::size_t n);
-    void trim_left();
-};
\ No newline at end of file
+    // The byte at `pos`, or -1 past the end of the text.
+    int follow(std::size_t pos) const;
+    Token resume_raw();
+    std::size_t raw_string(std::size_t rule, std::size_t pos,
+                           State& after) const;
+    std::size_t raw_string_end(const State& state, std::size_t pos) const;
+    std::pair<std::size_t, std::size_t> match(Dfa::StateId state,
+                                              std::size_t limit) const;
+};
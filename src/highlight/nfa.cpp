@@ -0,0 +1,300 @@
+#include "highlight/nfa.hpp"
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+Nfa::Nfa() { add_state(); }
+
+const std::vector<Nfa::State>& Nfa::states() const { return m_states; }
+
+std::size_t Nfa::rule_count() const { return m_follow.size(); }
+
+const Nfa::Bytes& Nfa::follow(std::size_t rule) const {
+    return m_follow[rule];
+}
+
+void Nfa::add_pattern(std::string_view pattern) {
+    m_pattern = pattern;
+    m_pos = 0;
+
+    Fragment fragment = parse_alternation();
+    Bytes follow = Bytes{}.set();
+
+    if (at_lookahead()) {
+        m_pos += 3;
+        follow = parse_bytes();
+
+        if (at_end() || take() != ')') {
+            fail("unterminated lookahead");
+        }
+    }
+
+    if (!at_end()) {
+        fail("unmatched )");
+    }
+
+    // An empty match would make for an empty token, and the lexer would
+    // never move on.
+    std::vector<std::size_t> stack{fragment.start};
+    std::vector<bool> seen(m_states.size());
+
+    while (!stack.empty()) {
+        std::size_t state = stack.back();
+        stack.pop_back();
+
+        if (state == fragment.end) {
+            fail("matches empty text");
+        }
+        if (seen[state]) {
+            continue;
+        }
+
+        seen[state] = true;
+        stack.insert(stack.end(), m_states[state].epsilon.begin(),
+                     m_states[state].epsilon.end());
+    }
+
+    add_rule(fragment, follow);
+}
+
+void Nfa::add_literal(std::string_view text) {
+    if (text.empty()) {
+        throw std::runtime_error{"Empty literal"};
+    }
+
+    std::size_t start = add_state();
+    std::size_t end = start;
+
+    for (char c : text) {
+        Fragment next = bytes(Bytes{}.set(static_cast<unsigned char>(c)));
+        m_states[end].epsilon.push_back(next.start);
+        end = next.end;
+    }
+
+    add_rule({start, end}, Bytes{}.set());
+}
+
+std::size_t Nfa::add_state() {
+    m_states.emplace_back();
+    return m_states.size() - 1;
+}
+
+Nfa::Fragment Nfa::bytes(const Bytes& bytes) {
+    std::size_t start = add_state();
+    std::size_t end = add_state();
+
+    m_states[start].bytes = bytes;
+    m_states[start].next = end;
+    return {start, end};
+}
+
+void Nfa::add_rule(Fragment fragment, const Bytes& follow) {
+    m_states[start].epsilon.push_back(fragment.start);
+    m_states[fragment.end].rule = m_follow.size();
+    m_follow.push_back(follow);
+}
+
+Nfa::Fragment Nfa::parse_alternation() {
+    Fragment fragment = parse_sequence();
+
+    while (!at_end() && peek() == '|') {
+        take();
+        Fragment other = parse_sequence();
+
+        std::size_t start = add_state();
+        std::size_t end = add_state();
+
+        m_states[start].epsilon = {fragment.start, other.start};
+        m_states[fragment.end].epsilon.push_back(end);
+        m_states[other.end].epsilon.push_back(end);
+        fragment = {start, end};
+    }
+
+    return fragment;
+}
+
+Nfa::Fragment Nfa::parse_sequence() {
+    std::size_t start = add_state();
+    Fragment fragment{start, start};
+
+    while (!at_end() && peek() != '|' && peek() != ')' && !at_lookahead()) {
+        Fragment next = parse_repetition();
+        m_states[fragment.end].epsilon.push_back(next.start);
+        fragment.end = next.end;
+    }
+
+    return fragment;
+}
+
+Nfa::Fragment Nfa::parse_repetition() {
+    Fragment fragment;
+
+    if (peek() == '(') {
+        take();
+        fragment = parse_alternation();
+
+        if (at_end() || take() != ')') {
+            fail("unmatched (");
+        }
+    } else {
+        fragment = bytes(parse_bytes());
+    }
+
+    while (!at_end()
+           && (peek() == '*' || peek() == '+' || peek() == '?')) {
+        char repetition = take();
+        std::size_t start = add_state();
+        std::size_t end = add_state();
+
+        m_states[start].epsilon = {fragment.start};
+        m_states[fragment.end].epsilon = {end};
+
+        if (repetition != '+') {
+            m_states[start].epsilon.push_back(end);
+        }
+        if (repetition != '?') {
+            m_states[fragment.end].epsilon.push_back(fragment.start);
+        }
+
+        fragment = {start, end};
+    }
+
+    return fragment;
+}
+
+Nfa::Bytes Nfa::parse_bytes() {
+    if (at_end()) {
+        fail("unexpected end");
+    }
+
+    char c = take();
+
+    switch (c) {
+    case '.':
+        return Bytes{}.set().reset('\n');
+    case '[':
+        return parse_class();
+    case '\\':
+        return parse_escape();
+    case '*':
+    case '+':
+    case '?':
+        fail("nothing to repeat");
+    case '|':
+    case ')':
+        fail("unexpected " + std::string{c});
+    default:
+        return Bytes{}.set(static_cast<unsigned char>(c));
+    }
+}
+
+Nfa::Bytes Nfa::parse_class() {
+    Bytes bytes;
+    bool negated = !at_end() && peek() == '^';
+
+    if (negated) {
+        take();
+    }
+
+    // A leading `]` is part of the class rather than its end.
+    for (bool first = true; at_end() || peek() != ']' || first;
+         first = false) {
+        if (at_end()) {
+            fail("unterminated class");
+        }
+
+        char c = take();
+        Bytes item = c == '\\' ? parse_escape()
+                               : Bytes{}.set(static_cast<unsigned char>(c));
+
+        if (item.count() != 1 || m_pos + 1 >= m_pattern.size()
+            || peek() != '-' || m_pattern[m_pos + 1] == ']') {
+            bytes |= item;
+            continue;
+        }
+
+        take();
+        char last = take();
+        Bytes end = last == '\\'
+                        ? parse_escape()
+                        : Bytes{}.set(static_cast<unsigned char>(last));
+
+        if (end.count() != 1) {
+            fail("bad range");
+        }
+
+        std::size_t low = 0;
+        std::size_t high = 0;
+
+        while (!item[low]) {
+            ++low;
+        }
+        while (!end[high]) {
+            ++high;
+        }
+        if (low > high) {
+            fail("bad range");
+        }
+
+        for (std::size_t b = low; b <= high; ++b) {
+            bytes.set(b);
+        }
+    }
+
+    take();
+    return negated ? ~bytes : bytes;
+}
+
+Nfa::Bytes Nfa::parse_escape() {
+    if (at_end()) {
+        fail("trailing backslash");
+    }
+
+    Bytes bytes;
+    char c = take();
+
+    switch (c) {
+    case 'n':
+        return bytes.set('\n');
+    case 't':
+        return bytes.set('\t');
+    case 'r':
+        return bytes.set('\r');
+    case 'd':
+        for (char d = '0'; d <= '9'; ++d) {
+            bytes.set(d);
+        }
+        return bytes;
+    case 'w':
+        for (std::size_t b = 0; b < bytes.size(); ++b) {
+            bytes[b] = (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z')
+                       || (b >= '0' && b <= '9') || b == '_';
+        }
+        return bytes;
+    case 's':
+        for (char s : std::string_view{" \t\r\n\v\f"}) {
+            bytes.set(s);
+        }
+        return bytes;
+    default:
+        return bytes.set(static_cast<unsigned char>(c));
+    }
+}
+
+bool Nfa::at_end() const { return m_pos >= m_pattern.size(); }
+
+bool Nfa::at_lookahead() const {
+    return m_pattern.substr(m_pos).starts_with("(?=");
+}
+
+char Nfa::peek() const { return m_pattern[m_pos]; }
+
+char Nfa::take() { return m_pattern[m_pos++]; }
+
+void Nfa::fail(std::string_view message) const {
+    throw std::runtime_error{"Bad pattern `" + std::string{m_pattern}
+                             + "`: " + std::string{message}};
+}
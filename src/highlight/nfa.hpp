@@ -0,0 +1,79 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Rules of a language compiled by Thompson's construction, as the first
+// step towards a DFA. Rules are numbered in the order they are added; of
+// two rules matching the same text, the lower number wins.
+//
+// Patterns are regular expressions over bytes: literals, `.` (any byte but
+// a line feed), classes such as `[^a-z_]`, groups, `|`, and the `*`, `+`
+// and `?` repetitions. `\n`, `\t`, `\r`, `\d`, `\w` and `\s` stand for the
+// usual bytes, and any other escaped byte for itself. A pattern may end in
+// a lookahead such as `(?=\()`, a single byte or class that has to follow
+// the match without being part of it.
+class Nfa {
+public:
+    using Bytes = std::bitset<256>;
+
+    static constexpr std::size_t none = static_cast<std::size_t>(-1);
+
+    struct State {
+        // Bytes that lead on to `next`, if that is not none.
+        Bytes bytes{};
+        std::size_t next{none};
+        std::vector<std::size_t> epsilon{};
+        // The rule a match reaching this state is of, or none.
+        std::size_t rule{none};
+    };
+
+    Nfa();
+
+    // Adds a rule matching `pattern`, throwing std::runtime_error if it is
+    // malformed.
+    void add_pattern(std::string_view pattern);
+    // Adds a rule matching exactly `text`.
+    void add_literal(std::string_view text);
+
+    const std::vector<State>& states() const;
+    static constexpr std::size_t start = 0;
+
+    std::size_t rule_count() const;
+    // The bytes that may follow a match of `rule`.
+    const Bytes& follow(std::size_t rule) const;
+
+private:
+    // A part of the automaton with a single way in and a single way out,
+    // `end` having no transitions yet.
+    struct Fragment {
+        std::size_t start{};
+        std::size_t end{};
+    };
+
+    std::vector<State> m_states{};
+    std::vector<Bytes> m_follow{};
+
+    // The pattern being parsed.
+    std::string_view m_pattern{};
+    std::size_t m_pos{};
+
+    std::size_t add_state();
+    Fragment bytes(const Bytes& bytes);
+    void add_rule(Fragment fragment, const Bytes& follow);
+
+    Fragment parse_alternation();
+    Fragment parse_sequence();
+    Fragment parse_repetition();
+    Bytes parse_bytes();
+    Bytes parse_class();
+    Bytes parse_escape();
+
+    bool at_end() const;
+    bool at_lookahead() const;
+    char peek() const;
+    char take();
+    [[noreturn]] void fail(std::string_view message) const;
+};
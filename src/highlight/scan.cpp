@@ -0,0 +1,214 @@
+#include "highlight/scan.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JALEDIT_SCAN_X86
+#endif
+
+ByteSet::ByteSet(const std::array<bool, 256>& bytes) : m_bytes{bytes} {
+    for (std::size_t b = 0; b < bytes.size(); ++b) {
+        if (!bytes[b]) {
+            if (m_exit_count < max_exits) {
+                m_exits[m_exit_count] = static_cast<char>(b);
+            }
+            ++m_exit_count;
+            continue;
+        }
+
+        auto bit = static_cast<std::uint8_t>(1u << (b >> 4 & 7));
+        (b < 0x80 ? m_low : m_high)[b & 0x0f] |= bit;
+    }
+}
+
+std::size_t ByteSet::span_long(std::string_view text,
+                               std::size_t pos) const {
+    static const Scanner scanner = select_scanner();
+
+    if (m_exit_count == 0) {
+        return text.size();
+    }
+
+    // The C library's memchr is vectorized already, and faster than the
+    // scanners below at finding a single byte.
+    if (m_exit_count == 1) {
+        return span_scalar(*this, text, pos);
+    }
+
+    return scanner(*this, text, pos);
+}
+
+std::size_t ByteSet::span_scalar(const ByteSet& set, std::string_view text,
+                                 std::size_t pos) {
+    if (set.m_exit_count == 1) {
+        const void* found = std::memchr(text.data() + pos, set.m_exits[0],
+                                        text.size() - pos);
+
+        return found == nullptr
+                   ? text.size()
+                   : static_cast<const char*>(found) - text.data();
+    }
+
+    while (pos < text.size() && set.contains(text[pos])) {
+        ++pos;
+    }
+
+    return pos;
+}
+
+#ifdef JALEDIT_SCAN_X86
+
+char ByteSet::exit(std::size_t i) const {
+    // Unused slots repeat the first exit, which is always there.
+    return m_exits[i < m_exit_count ? i : 0];
+}
+
+// Each vector scanner builds a mask with a bit set for every byte of a
+// block that is not in the set, and stops at the lowest one. What is left
+// of the text once less than a block remains goes to a narrower scanner.
+
+std::size_t ByteSet::span_sse2(const ByteSet& set, std::string_view text,
+                               std::size_t pos) {
+    // Without shuffles, only sets with few exits are worth vectorizing.
+    if (set.m_exit_count > max_exits) {
+        return span_scalar(set, text, pos);
+    }
+
+    const __m128i first = _mm_set1_epi8(set.exit(0));
+    const __m128i second = _mm_set1_epi8(set.exit(1));
+    const __m128i third = _mm_set1_epi8(set.exit(2));
+
+    for (; pos + 16 <= text.size(); pos += 16) {
+        __m128i block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(text.data() + pos));
+        __m128i out = _mm_or_si128(
+            _mm_cmpeq_epi8(block, first),
+            _mm_or_si128(_mm_cmpeq_epi8(block, second),
+                         _mm_cmpeq_epi8(block, third)));
+
+        if (auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(out))) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+
+    return span_scalar(set, text, pos);
+}
+
+[[gnu::target("ssse3")]] std::size_t
+ByteSet::span_ssse3(const ByteSet& set, std::string_view text,
+                    std::size_t pos) {
+    if (set.m_exit_count <= max_exits) {
+        return span_sse2(set, text, pos);
+    }
+
+    const __m128i low
+        = _mm_load_si128(reinterpret_cast<const __m128i*>(set.m_low.data()));
+    const __m128i high
+        = _mm_load_si128(reinterpret_cast<const __m128i*>(set.m_high.data()));
+    // The bit each high nibble has in the rows of the tables.
+    const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4,
+                                       8, 16, 32, 64, -128);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i top = _mm_set1_epi8(-128);
+
+    for (; pos + 16 <= text.size(); pos += 16) {
+        __m128i block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(text.data() + pos));
+        // Shuffles give zero where the top bit of the index is set, which
+        // picks the table that covers each byte.
+        __m128i index = _mm_and_si128(block, _mm_set1_epi8(-113));
+        __m128i rows
+            = _mm_or_si128(_mm_shuffle_epi8(low, index),
+                           _mm_shuffle_epi8(high, _mm_xor_si128(index, top)));
+        __m128i bit = _mm_shuffle_epi8(
+            bits, _mm_and_si128(_mm_srli_epi16(block, 4), nibble));
+        __m128i out = _mm_cmpeq_epi8(_mm_and_si128(rows, bit),
+                                     _mm_setzero_si128());
+
+        if (auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(out))) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+
+    return span_scalar(set, text, pos);
+}
+
+[[gnu::target("avx2")]] std::size_t
+ByteSet::span_avx2(const ByteSet& set, std::string_view text,
+                   std::size_t pos) {
+    if (set.m_exit_count <= max_exits) {
+        const __m256i first = _mm256_set1_epi8(set.exit(0));
+        const __m256i second = _mm256_set1_epi8(set.exit(1));
+        const __m256i third = _mm256_set1_epi8(set.exit(2));
+
+        for (; pos + 32 <= text.size(); pos += 32) {
+            __m256i block = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(text.data() + pos));
+            __m256i out = _mm256_or_si256(
+                _mm256_cmpeq_epi8(block, first),
+                _mm256_or_si256(_mm256_cmpeq_epi8(block, second),
+                                _mm256_cmpeq_epi8(block, third)));
+
+            if (auto mask
+                = static_cast<std::uint32_t>(_mm256_movemask_epi8(out))) {
+                return pos + __builtin_ctz(mask);
+            }
+        }
+
+        return span_sse2(set, text, pos);
+    }
+
+    // Shuffles work within each 128-bit lane, so both get the tables.
+    const __m256i low = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(set.m_low.data())));
+    const __m256i high = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(set.m_high.data())));
+    const __m256i bits = _mm256_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8,
+        16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i top = _mm256_set1_epi8(-128);
+
+    for (; pos + 32 <= text.size(); pos += 32) {
+        __m256i block = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(text.data() + pos));
+        __m256i index = _mm256_and_si256(block, _mm256_set1_epi8(-113));
+        __m256i rows = _mm256_or_si256(
+            _mm256_shuffle_epi8(low, index),
+            _mm256_shuffle_epi8(high, _mm256_xor_si256(index, top)));
+        __m256i bit = _mm256_shuffle_epi8(
+            bits, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+        __m256i out = _mm256_cmpeq_epi8(_mm256_and_si256(rows, bit),
+                                        _mm256_setzero_si256());
+
+        if (auto mask
+            = static_cast<std::uint32_t>(_mm256_movemask_epi8(out))) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+
+    return span_ssse3(set, text, pos);
+}
+
+#endif
+
+ByteSet::Scanner ByteSet::select_scanner() {
+#ifdef JALEDIT_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return span_avx2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return span_ssse3;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return span_sse2;
+    }
+#endif
+    return span_scalar;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// A set of bytes that runs of text are made of, such as the characters of
+// a name or anything but the end of a comment, for finding where such runs
+// end 16 or 32 bytes at a time. The widest instruction set the CPU
+// supports (AVX2, SSSE3, SSE2, or none) is picked once at startup.
+class ByteSet {
+public:
+    // Sets that leave out this many bytes or fewer are scanned by comparing
+    // against each of those bytes rather than by looking bytes up.
+    static constexpr std::size_t max_exits = 3;
+
+    ByteSet() = default;
+    explicit ByteSet(const std::array<bool, 256>& bytes);
+
+    bool contains(char byte) const {
+        return m_bytes[static_cast<unsigned char>(byte)];
+    }
+
+    // The position of the first byte in `text`, from `pos` on, that is not
+    // in the set, or the end of the text if there is none.
+    std::size_t span(std::string_view text, std::size_t pos) const {
+        // Most runs, as of names and spaces, end before a vector scan would
+        // pay off.
+        std::size_t end = std::min(text.size(), pos + short_run);
+
+        for (; pos < end; ++pos) {
+            if (!contains(text[pos])) {
+                return pos;
+            }
+        }
+
+        return pos < text.size() ? span_long(text, pos) : pos;
+    }
+
+private:
+    static constexpr std::size_t short_run = 8;
+
+    std::array<bool, 256> m_bytes{};
+
+    // The bytes not in the set, if there are no more than max_exits.
+    std::size_t m_exit_count{};
+    std::array<char, max_exits> m_exits{};
+
+    // Bit `h % 8` of row `l` is set when the byte with high nibble `h` and
+    // low nibble `l` is in the set: bytes below 0x80 in m_low, the others
+    // in m_high. A byte is classified with two shuffles on its low nibble.
+    alignas(16) std::array<std::uint8_t, 16> m_low{};
+    alignas(16) std::array<std::uint8_t, 16> m_high{};
+
+    std::size_t span_long(std::string_view text, std::size_t pos) const;
+    // Exit `i`, or the first one past the last.
+    char exit(std::size_t i) const;
+
+    static std::size_t span_scalar(const ByteSet& set, std::string_view text,
+                                   std::size_t pos);
+    static std::size_t span_sse2(const ByteSet& set, std::string_view text,
+                                 std::size_t pos);
+    static std::size_t span_ssse3(const ByteSet& set, std::string_view text,
+                                  std::size_t pos);
+    static std::size_t span_avx2(const ByteSet& set, std::string_view text,
+                                 std::size_t pos);
+
+    using Scanner = std::size_t (*)(const ByteSet& set, std::string_view text,
+                                    std::size_t pos);
+    static Scanner select_scanner();
+};
@@ -0,0 +1,249 @@
+#include "highlight/cache.hpp"
+#include "highlight/language.hpp"
+#include "highlight/lexer.hpp"
+#include "test.hpp"
+
+#include <cstddef>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Checks the lexer and the highlight cache against the definitions in
+// data/languages. Run it from the repository root.
+
+namespace {
+
+// The state each line starts in, lexing every line from the top.
+std::vector<Lexer::State> lex_all(const Language& language,
+                                  const std::vector<std::string>& lines) {
+    std::vector<Lexer::State> states{Lexer::State{}};
+
+    for (const auto& line : lines) {
+        states.push_back(Lexer::end_state(language, line, states.back()));
+    }
+
+    return states;
+}
+
+// Expects every line the cache knows the state of to start in the state
+// lexing from the top gives.
+void expect_states(HighlightCache& cache,
+                   const std::vector<std::string>& lines) {
+    const Language& language = cache.language();
+    auto expected = lex_all(language, lines);
+    auto read = [&lines](std::size_t line) { return lines[line]; };
+
+    for (std::size_t line = 0; line < lines.size(); ++line) {
+        test::expect(cache.state(line, read) == expected[line]);
+    }
+}
+
+void test_relex_after_two_edits() {
+    const Language& cpp = Language::for_file("x.cpp");
+    std::vector<std::string> lines(300, "int x;");
+    auto read = [&lines](std::size_t line) { return lines[line]; };
+
+    HighlightCache cache;
+    cache.set_language(cpp);
+    cache.state(lines.size() - 1, read);
+
+    // Opening a comment changes the state of every line after it, but only
+    // the lines up to the edit are drawn.
+    lines[200] = "/* open";
+    cache.edit(0, 200, 0, 0);
+    cache.state(200, read);
+
+    // A second edit further up, drawn up to a line before the first one,
+    // must not end the relexing before it has gone past the first edit.
+    lines[100] = "int y;";
+    cache.edit(0, 100, 0, 0);
+    cache.state(150, read);
+
+    auto expected = lex_all(cpp, lines);
+    test::expect(expected[250] != Lexer::State{});
+    test::expect(cache.state(250, read) == expected[250]);
+    expect_states(cache, lines);
+}
+
+// The tokens of a line that starts in `state`, as kinds and text.
+std::vector<std::pair<TokenKind, std::string>>
+tokens(const Language& language, std::string_view text,
+       Lexer::State state = {}) {
+    std::vector<std::pair<TokenKind, std::string>> result;
+    Lexer lexer{language, text, state};
+
+    for (Token token = lexer.next(); token.kind() != TokenKind::End;
+         token = lexer.next()) {
+        result.emplace_back(token.kind(), std::string{token.text()});
+    }
+
+    return result;
+}
+
+// Random edits of a few lines at a time, with a line drawn now and then,
+// leave the cache knowing the same states as lexing from the top.
+void test_random_relex() {
+    const Language& cpp = Language::for_file("x.cpp");
+    std::vector<std::string> pool{
+        "int x;",  "/* open", "close */", "a */ b /* c", R"cpp(R"x(raw)cpp",
+        R"cpp()x";)cpp", "// line", "#define A \\", R"cpp("str";)cpp", "",
+    };
+    std::mt19937_64 random{22};
+    auto pick = [&] { return pool[random() % pool.size()]; };
+
+    std::vector<std::string> lines(400);
+    for (auto& line : lines) {
+        line = pick();
+    }
+    auto read = [&lines](std::size_t line) { return lines[line]; };
+
+    HighlightCache cache;
+    cache.set_language(cpp);
+
+    for (std::size_t step = 0; step < 2000; ++step) {
+        // Lines `index` to `index + removed` are replaced by `inserted + 1`
+        // others.
+        std::size_t index = random() % lines.size();
+        std::size_t removed = std::min<std::size_t>(random() % 3,
+                                                    lines.size() - index - 1);
+        std::size_t inserted = random() % 3;
+
+        auto first = lines.begin() + static_cast<std::ptrdiff_t>(index);
+        first = lines.erase(first, first + static_cast<std::ptrdiff_t>(
+                                               removed + 1));
+        for (std::size_t i = 0; i <= inserted; ++i) {
+            first = lines.insert(first, pick());
+        }
+        cache.edit(0, index, removed, inserted);
+
+        if (random() % 3 == 0) {
+            cache.state(random() % lines.size(), read);
+        }
+        if (step % 100 == 0) {
+            expect_states(cache, lines);
+        }
+    }
+
+    expect_states(cache, lines);
+}
+
+// The longest match wins, and of matches as long, the first rule.
+void test_token_kinds() {
+    const Language& cpp = Language::for_file("x.cpp");
+    using Tokens = std::vector<std::pair<TokenKind, std::string>>;
+    using enum TokenKind;
+
+    test::expect(tokens(cpp, "if (size(x) >= 0x1f) return Foo;")
+                 == Tokens{{Keyword, "if"},
+                           {Invalid, " "},
+                           {OpenParen, "("},
+                           {Function, "size"},
+                           {OpenParen, "("},
+                           {Symbol, "x"},
+                           {CloseParen, ")"},
+                           {Invalid, " "},
+                           {Operator, ">="},
+                           {Invalid, " "},
+                           {Number, "0x1f"},
+                           {CloseParen, ")"},
+                           {Invalid, " "},
+                           {Keyword, "return"},
+                           {Invalid, " "},
+                           {Type, "Foo"},
+                           {Semicolon, ";"}});
+    test::expect(tokens(cpp, "int integer<<=1.5e+3")
+                 == Tokens{{Type, "int"},
+                           {Invalid, " "},
+                           {Symbol, "integer"},
+                           {Operator, "<<="},
+                           {Number, "1.5e+3"}});
+    test::expect(tokens(cpp, "[[x]]\t\t@")
+                 == Tokens{{OpenAttr, "[["},
+                           {Symbol, "x"},
+                           {CloseAttr, "]]"},
+                           {Invalid, "\t"},
+                           {Invalid, "\t"},
+                           {Invalid, "@"}});
+    test::expect(tokens(cpp, R"cpp(L"a\"b" 'c' "open)cpp")
+                 == Tokens{{String, R"cpp(L"a\"b")cpp"},
+                           {Invalid, " "},
+                           {Char, "'c'"},
+                           {Invalid, " "},
+                           {String, R"cpp("open)cpp"}});
+    test::expect(tokens(cpp, "x; // y */")
+                 == Tokens{{Symbol, "x"},
+                           {Semicolon, ";"},
+                           {Invalid, " "},
+                           {Comment, "// y */"}});
+
+    // Block comments and continued directives carry on into the next line,
+    // and unterminated strings do not.
+    std::vector<std::string> lines{"/* a", "b */ c", "#define A \\", "1",
+                                   R"cpp("open)cpp", "d"};
+    auto states = lex_all(cpp, lines);
+    test::expect(tokens(cpp, lines[1], states[1])
+                 == Tokens{{Comment, "b */"}, {Invalid, " "}, {Symbol, "c"}});
+    test::expect(tokens(cpp, lines[3], states[3]) == Tokens{{Preproc, "1"}});
+    test::expect(states[4] == Lexer::State{});
+    test::expect(states[5] == Lexer::State{});
+}
+
+void test_raw_strings() {
+    const Language& cpp = Language::for_file("x.cpp");
+    using Tokens = std::vector<std::pair<TokenKind, std::string>>;
+
+    test::expect(tokens(cpp, R"cpp(R"(a)" x)cpp")
+                 == Tokens{{TokenKind::String, R"cpp(R"(a)")cpp"},
+                           {TokenKind::Invalid, " "},
+                           {TokenKind::Symbol, "x"}});
+    test::expect(tokens(cpp, R"cpp(u8R"-(a)" b)-";)cpp")
+                 == Tokens{{TokenKind::String, R"cpp(u8R"-(a)" b)-")cpp"},
+                           {TokenKind::Semicolon, ";"}});
+
+    // A delimiter that is too long or holds a space is no delimiter, and
+    // only the opening is taken.
+    std::pair opening{TokenKind::String, std::string{R"cpp(R")cpp"}};
+    std::string long_delimiter = "0123456789abcdefg";
+    test::expect(tokens(cpp, "R\"" + long_delimiter + "(a)" + long_delimiter
+                                 + "\"")
+                     .front()
+                 == opening);
+    test::expect(tokens(cpp, R"cpp(R"a b(c)a b")cpp").front() == opening);
+
+    // Only the delimiter the string was opened with closes it, however
+    // many lines later.
+    std::vector<std::string> lines{R"cpp(auto s = R"x(one)cpp",
+                                   R"cpp(two )" // not yet)cpp",
+                                   "",
+                                   R"cpp(three)x"; int y;)cpp",
+                                   "int z;"};
+    auto states = lex_all(cpp, lines);
+
+    for (std::size_t line = 1; line <= 3; ++line) {
+        test::expect(states[line].raw != Dfa::none);
+    }
+    test::expect(states[4] == Lexer::State{});
+    test::expect(tokens(cpp, lines[1], states[1])
+                 == Tokens{{TokenKind::String, lines[1]}});
+    test::expect(tokens(cpp, lines[3], states[3]).front()
+                 == std::pair{TokenKind::String,
+                              std::string{R"cpp(three)x")cpp"}});
+
+    // The cache carries the string across lines like any other token.
+    HighlightCache cache;
+    cache.set_language(cpp);
+    expect_states(cache, lines);
+}
+
+} // namespace
+
+int main() {
+    test::run("relex after two edits", test_relex_after_two_edits);
+    test::run("random relex", test_random_relex);
+    test::run("token kinds", test_token_kinds);
+    test::run("raw strings", test_raw_strings);
+
+    return test::result();
+}
@@ -4,7 +4,6 @@
 
 #include <array>
 #include <cstddef>
-#include <string>
 #include <string_view>
 
 namespace constants {
@@ -88,12 +87,8 @@ public:
 
 private:
     TokenKind m_kind{};
-    std::string m_text{};
-};
-
-struct LiteralToken {
-    std::string_view text;
-    TokenKind kind;
+    // Views the text that was lexed, which has to outlive the token.
+    std::string_view m_text{};
 };
 
 struct HighlightedToken {
@@ -6,8 +6,6 @@ int main(int argc, char** argv) {
     SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_MSAA_4X_HINT | FLAG_VSYNC_HINT);
     SetTargetFPS(144);
 
-    Editor editor = argc > 1 ? Editor(argv[1]) : Editor("");
-
     InitWindow(constants::window::width, constants::window::height,
                "jaledit: just a little editor");
     SetExitKey(KEY_NULL);
@@ -17,6 +15,10 @@ int main(int argc, char** argv) {
     SetWindowIcon(icon);
     UnloadImage(icon);
 
+    // Large files finish loading in the background, so the window comes up
+    // first and shows the beginning of the file right away.
+    Editor editor = argc > 1 ? Editor(argv[1]) : Editor("");
+
     while (!WindowShouldClose()) {
         BeginDrawing();
 
@@ -0,0 +1,113 @@
+#include "rope/btree_rope.hpp"
+#include "rope/rope.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compares the binary-tree Rope against the B-tree engine on a synthetic
+// buffer. Usage: bench_rope [size in MiB, default 256]
+
+namespace {
+
+constexpr std::size_t query_count = 1'000'000;
+constexpr std::size_t edit_count = 10'000;
+
+using Clock = std::chrono::steady_clock;
+
+std::string make_text(std::size_t size) {
+    std::mt19937_64 random{42};
+    std::uniform_int_distribution<std::size_t> line_length{0, 120};
+
+    std::string text;
+    text.reserve(size);
+
+    while (text.size() < size) {
+        text.append(line_length(random), 'x');
+        text.push_back('\n');
+    }
+
+    text.resize(size);
+    return text;
+}
+
+void report(std::string_view engine, std::string_view operation,
+            Clock::duration elapsed, std::size_t count) {
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    std::cout << std::left << std::setw(8) << engine << std::setw(18)
+              << operation << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << ns / static_cast<double>(count) << " ns/op"
+              << std::endl;
+}
+
+// Runs every measurement on one engine. Queries and edits are drawn from
+// the same seed for both engines, and the returned checksum has to match.
+template<typename Engine>
+std::size_t run(std::string_view name, const std::string& text) {
+    auto start = Clock::now();
+    Engine rope{text};
+    report(name, "build", Clock::now() - start, 1);
+
+    std::mt19937_64 random{7};
+    std::uniform_int_distribution<std::size_t> line{0,
+                                                    rope.line_count() - 1};
+    std::uniform_int_distribution<std::size_t> index{0, rope.length() - 1};
+    std::size_t checksum = 0;
+
+    start = Clock::now();
+    for (std::size_t i = 0; i < query_count; ++i) {
+        checksum += rope.find_line_start(line(random));
+    }
+    report(name, "find_line_start", Clock::now() - start, query_count);
+
+    start = Clock::now();
+    for (std::size_t i = 0; i < query_count; ++i) {
+        checksum += rope.index_from_pos(line(random), 3);
+    }
+    report(name, "index_from_pos", Clock::now() - start, query_count);
+
+    start = Clock::now();
+    for (std::size_t i = 0; i < query_count; ++i) {
+        checksum += static_cast<unsigned char>(rope[index(random)]);
+    }
+    report(name, "operator[]", Clock::now() - start, query_count);
+
+    start = Clock::now();
+    for (std::size_t i = 0; i < edit_count; ++i) {
+        rope = rope.insert(index(random), std::string{"y"});
+    }
+    report(name, "insert", Clock::now() - start, edit_count);
+
+    start = Clock::now();
+    for (std::size_t i = 0; i < edit_count; ++i) {
+        rope = rope.erase(index(random), 1);
+    }
+    report(name, "erase", Clock::now() - start, edit_count);
+
+    return checksum + rope.length() + rope.line_count();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::size_t mebibytes
+        = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 256;
+    std::string text = make_text(mebibytes * 1024 * 1024);
+
+    std::cout << mebibytes << " MiB, " << query_count << " queries, "
+              << edit_count << " edits" << std::endl;
+
+    std::size_t binary = run<Rope>("rope", text);
+    std::size_t btree = run<BTreeRope>("btree", text);
+
+    if (binary != btree) {
+        std::cerr << "engines disagree" << std::endl;
+        return EXIT_FAILURE;
+    }
+}
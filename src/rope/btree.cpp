@@ -0,0 +1,262 @@
+#include "rope/btree.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rope::btree {
+
+namespace {
+
+// Cuts `text` into as few leaves as fit, all of nearly equal length, so
+// that none of them is underfull unless the whole text is.
+std::vector<Handle> chop(std::string_view text) {
+    std::size_t count
+        = std::max<std::size_t>(1, (text.size() + max_leaf_length - 1)
+                                       / max_leaf_length);
+    std::vector<Handle> leaves;
+    leaves.reserve(count);
+
+    for (std::size_t i = 0, start = 0; i < count; ++i) {
+        std::size_t end = text.size() * (i + 1) / count;
+        leaves.push_back(
+            make<Leaf>(std::string{text.substr(start, end - start)}));
+        start = end;
+    }
+
+    return leaves;
+}
+
+// Replaces nodes[index, index + 2) with `merged`.
+void splice(std::vector<Handle>& nodes, std::size_t index,
+            const std::vector<Handle>& merged) {
+    auto position = nodes.erase(nodes.begin() + index,
+                                nodes.begin() + index + 2);
+    nodes.insert(position, merged.begin(), merged.end());
+}
+
+} // namespace
+
+Node::Node(std::size_t height)
+    : m_height{static_cast<std::uint32_t>(height)} {}
+
+void Node::operator delete(Node* node, std::destroying_delete_t) {
+    if (node->is_leaf()) {
+        static_cast<Leaf*>(node)->~Leaf();
+        pool::deallocate(node, sizeof(Leaf));
+    } else {
+        static_cast<Internal*>(node)->~Internal();
+        pool::deallocate(node, sizeof(Internal));
+    }
+}
+
+bool Node::underfull() const {
+    if (is_leaf()) {
+        return m_length < min_leaf_length;
+    }
+    return static_cast<const Internal&>(*this).count() < min_children;
+}
+
+Leaf::Leaf(std::string text) : Node{0}, m_text{std::move(text)} {
+    m_length = m_text.size();
+
+    for (std::size_t i = 0; i < m_length; ++i) {
+        if (m_text[i] == '\n') {
+            m_lfpos.push_back(static_cast<std::uint16_t>(i));
+        }
+    }
+
+    m_lfcnt = m_lfpos.size();
+}
+
+Internal::Internal(std::span<const Handle> children)
+    : Node{children.front()->height() + 1}, m_count{children.size()} {
+    for (std::size_t i = 0; i < m_count; ++i) {
+        m_children[i] = children[i];
+        m_lengths[i] = children[i]->length();
+        m_lfcnts[i] = children[i]->lfcnt();
+        m_length += m_lengths[i];
+        m_lfcnt += m_lfcnts[i];
+    }
+}
+
+std::vector<Handle> pack(std::span<const Handle> nodes) {
+    std::size_t count = (nodes.size() + max_children - 1) / max_children;
+    std::vector<Handle> parents;
+    parents.reserve(count);
+
+    for (std::size_t i = 0, start = 0; i < count; ++i) {
+        std::size_t end = nodes.size() * (i + 1) / count;
+        parents.push_back(
+            make<Internal>(nodes.subspan(start, end - start)));
+        start = end;
+    }
+
+    return parents;
+}
+
+Handle build(std::string_view text) {
+    std::vector<Handle> nodes = chop(text);
+
+    while (nodes.size() > 1) {
+        nodes = pack(nodes);
+    }
+
+    return nodes.front();
+}
+
+std::vector<Handle> insert(const Handle& node, std::size_t index,
+                           std::string_view text) {
+    if (node->is_leaf()) {
+        std::string_view current = static_cast<const Leaf&>(*node).text();
+        std::string result;
+        result.reserve(current.size() + text.size());
+        result.append(current.substr(0, index));
+        result.append(text);
+        result.append(current.substr(index));
+        return chop(result);
+    }
+
+    const auto& internal = static_cast<const Internal&>(*node);
+    auto lengths = internal.lengths();
+    auto children = internal.children();
+
+    std::size_t i = 0;
+    while (i + 1 < internal.count() && index > lengths[i]) {
+        index -= lengths[i];
+        ++i;
+    }
+
+    std::vector<Handle> result{children.begin(), children.begin() + i};
+    std::vector<Handle> inserted = insert(children[i], index, text);
+    result.insert(result.end(), inserted.begin(), inserted.end());
+    result.insert(result.end(), children.begin() + i + 1, children.end());
+
+    return pack(result);
+}
+
+Handle erase(const Handle& node, std::size_t start, std::size_t length) {
+    std::size_t end = start + length;
+
+    if (node->is_leaf()) {
+        if (start == 0 && end >= node->length()) {
+            return nullptr;
+        }
+
+        std::string text{static_cast<const Leaf&>(*node).text()};
+        text.erase(start, length);
+        return make<Leaf>(std::move(text));
+    }
+
+    const auto& internal = static_cast<const Internal&>(*node);
+    auto lengths = internal.lengths();
+    auto children = internal.children();
+
+    std::vector<Handle> result;
+    result.reserve(internal.count());
+
+    for (std::size_t i = 0, offset = 0; i < internal.count(); ++i) {
+        std::size_t child_end = offset + lengths[i];
+
+        if (child_end <= start || offset >= end) {
+            result.push_back(children[i]);
+        } else if (offset < start || child_end > end) {
+            std::size_t from = std::max(start, offset) - offset;
+            std::size_t to = std::min(end, child_end) - offset;
+            if (auto child = erase(children[i], from, to - from)) {
+                result.push_back(std::move(child));
+            }
+        }
+
+        offset = child_end;
+    }
+
+    // Only the children on either edge of the range can have been left
+    // underfull. Merging never increases the count, so the result fits.
+    for (std::size_t i = 0; i < result.size() && result.size() > 1;) {
+        if (!result[i]->underfull()) {
+            ++i;
+            continue;
+        }
+
+        std::size_t left = i + 1 < result.size() ? i : i - 1;
+        std::vector<Handle> merged = merge(result[left], result[left + 1]);
+        splice(result, left, merged);
+        i = merged.size() == 1 ? left : left + merged.size();
+    }
+
+    if (result.empty()) {
+        return nullptr;
+    }
+    return make<Internal>(result);
+}
+
+std::vector<Handle> merge(const Handle& left, const Handle& right) {
+    if (left->is_leaf()) {
+        std::string text{static_cast<const Leaf&>(*left).text()};
+        text.append(static_cast<const Leaf&>(*right).text());
+        return chop(text);
+    }
+
+    auto left_children = static_cast<const Internal&>(*left).children();
+    auto right_children = static_cast<const Internal&>(*right).children();
+
+    std::vector<Handle> children{left_children.begin(), left_children.end()};
+    children.insert(children.end(), right_children.begin(),
+                    right_children.end());
+
+    std::size_t seam = left_children.size();
+    if (children[seam - 1]->underfull() || children[seam]->underfull()) {
+        splice(children, seam - 1, merge(children[seam - 1], children[seam]));
+    }
+
+    return pack(children);
+}
+
+char at(const Node& root, std::size_t index) {
+    const Node* node = &root;
+
+    while (!node->is_leaf()) {
+        const auto& internal = static_cast<const Internal&>(*node);
+        auto lengths = internal.lengths();
+
+        std::size_t i = 0;
+        while (index >= lengths[i]) {
+            index -= lengths[i];
+            ++i;
+        }
+
+        node = internal.children()[i].get();
+    }
+
+    return static_cast<const Leaf&>(*node).text()[index];
+}
+
+std::size_t find_line_feed(const Node& root, std::size_t lf_index) {
+    const Node* node = &root;
+    std::size_t offset = 0;
+
+    while (!node->is_leaf()) {
+        const auto& internal = static_cast<const Internal&>(*node);
+        auto lfcnts = internal.lfcnts();
+        auto lengths = internal.lengths();
+
+        std::size_t i = 0;
+        while (lf_index >= lfcnts[i]) {
+            lf_index -= lfcnts[i];
+            offset += lengths[i];
+            ++i;
+        }
+
+        node = internal.children()[i].get();
+    }
+
+    return offset + static_cast<const Leaf&>(*node).line_feed(lf_index);
+}
+
+} // namespace rope::btree
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "rope/handle.hpp"
+#include "rope/pool.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Nodes of the B-tree rope engine (see rope/btree_rope.hpp). Internal nodes
+// hold up to max_children children together with the byte and line feed
+// counts of each child in contiguous arrays, so a descent reads one or two
+// cache lines per level instead of chasing a pointer per binary branch.
+// All leaves sit at the same height.
+namespace rope::btree {
+
+constexpr std::size_t min_children = 8;
+constexpr std::size_t max_children = 16;
+
+constexpr std::size_t min_leaf_length = 1024;
+constexpr std::size_t max_leaf_length = 4096;
+
+class Node;
+using Handle = Ref<Node>;
+
+// Header shared by leaves and internal nodes. There are no virtual
+// functions: the height tells the two apart (leaves are at height 0), and
+// the destroying operator delete dispatches on it.
+class Node {
+public:
+    Node(const Node& other) = delete;
+    Node& operator=(const Node& other) = delete;
+
+    static void* operator new(std::size_t size) { return pool::allocate(size); }
+    static void operator delete(void* ptr, std::size_t size) {
+        pool::deallocate(ptr, size);
+    }
+    static void operator delete(Node* node, std::destroying_delete_t);
+
+    RefCount& refcount() const { return m_refcount; }
+
+    std::size_t length() const { return m_length; }
+    std::size_t lfcnt() const { return m_lfcnt; }
+    std::size_t height() const { return m_height; }
+    bool is_leaf() const { return m_height == 0; }
+
+    // Whether a non-root node has dropped below the minimum fill and has to
+    // be merged into a sibling.
+    bool underfull() const;
+
+protected:
+    explicit Node(std::size_t height);
+    ~Node() = default;
+
+    std::size_t m_length{};
+    std::size_t m_lfcnt{};
+    std::uint32_t m_height{};
+
+    mutable RefCount m_refcount{};
+};
+
+class Leaf : public Node {
+public:
+    explicit Leaf(std::string text);
+
+    std::string_view text() const { return m_text; }
+    // Position of the line feed with the given index within this leaf.
+    std::size_t line_feed(std::size_t index) const { return m_lfpos[index]; }
+
+private:
+    std::string m_text{};
+    // Leaves are at most max_leaf_length bytes, so offsets fit in 16 bits.
+    std::vector<std::uint16_t> m_lfpos{};
+};
+
+class Internal : public Node {
+public:
+    // All children must have the same height; there must be between one and
+    // max_children of them.
+    explicit Internal(std::span<const Handle> children);
+
+    std::size_t count() const { return m_count; }
+    std::span<const Handle> children() const {
+        return {m_children.data(), m_count};
+    }
+    std::span<const std::size_t> lengths() const {
+        return {m_lengths.data(), m_count};
+    }
+    std::span<const std::size_t> lfcnts() const {
+        return {m_lfcnts.data(), m_count};
+    }
+
+private:
+    std::size_t m_count{};
+    std::array<std::size_t, max_children> m_lengths{};
+    std::array<std::size_t, max_children> m_lfcnts{};
+    std::array<Handle, max_children> m_children{};
+};
+
+// Builds a tree holding `text`, with leaves between min_leaf_length and
+// max_leaf_length bytes long (save for a single short leaf).
+Handle build(std::string_view text);
+
+// Groups nodes of the same height under as few parents as fit, spreading
+// them evenly so that no parent is underfull unless there is only one.
+std::vector<Handle> pack(std::span<const Handle> nodes);
+
+// Inserts `text` at `index` and returns the replacement for `node`: one or
+// more siblings of the same height, none fuller than the bounds allow.
+std::vector<Handle> insert(const Handle& node, std::size_t index,
+                           std::string_view text);
+
+// Erases [start, start + length) and returns the replacement for `node`,
+// which has the same height but may be underfull, or is null if nothing is
+// left of it.
+Handle erase(const Handle& node, std::size_t start, std::size_t length);
+
+// Concatenates two nodes of the same height into one or two nodes, fixing
+// underfull nodes along the seam on every level below.
+std::vector<Handle> merge(const Handle& left, const Handle& right);
+
+char at(const Node& root, std::size_t index);
+
+// Position of the line feed with the given zero-based index.
+std::size_t find_line_feed(const Node& root, std::size_t lf_index);
+
+// Calls `visit` with a string_view of every leaf slice overlapping
+// [start, start + length), in order.
+template<typename Visitor>
+void for_each_chunk(const Node& node, std::size_t start, std::size_t length,
+                    Visitor& visit);
+
+} // namespace rope::btree
+
+#include "rope/btree_inl.hpp"
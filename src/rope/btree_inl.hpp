@@ -0,0 +1,40 @@
+#pragma once
+
+#include "rope/btree.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+
+namespace rope::btree {
+
+template<typename Visitor>
+void for_each_chunk(const Node& node, std::size_t start, std::size_t length,
+                    Visitor& visit) {
+    if (length == 0) {
+        return;
+    }
+
+    if (node.is_leaf()) {
+        visit(static_cast<const Leaf&>(node).text().substr(start, length));
+        return;
+    }
+
+    const auto& internal = static_cast<const Internal&>(node);
+    auto lengths = internal.lengths();
+    auto children = internal.children();
+
+    for (std::size_t i = 0; i < internal.count() && length > 0; ++i) {
+        if (start >= lengths[i]) {
+            start -= lengths[i];
+            continue;
+        }
+
+        std::size_t count = std::min(length, lengths[i] - start);
+        for_each_chunk(*children[i], start, count, visit);
+        length -= count;
+        start = 0;
+    }
+}
+
+} // namespace rope::btree
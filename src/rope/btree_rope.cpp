@@ -0,0 +1,167 @@
+#include "rope/btree_rope.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace rope::btree;
+
+namespace {
+
+// Drops single-child internal nodes left at the top by an erase, and turns
+// an empty tree into an empty leaf.
+Handle normalize(Handle root) {
+    if (!root) {
+        return rope::make<Leaf>("");
+    }
+
+    while (!root->is_leaf()
+           && static_cast<const Internal&>(*root).count() == 1) {
+        root = static_cast<const Internal&>(*root).children().front();
+    }
+
+    return root;
+}
+
+} // namespace
+
+BTreeRope::BTreeRope() : BTreeRope{std::string_view{}} {}
+
+BTreeRope::BTreeRope(std::string_view text) : m_root{build(text)} {}
+
+BTreeRope::BTreeRope(Handle root) : m_root{normalize(std::move(root))} {}
+
+std::string BTreeRope::to_string() const { return substr(0, length()); }
+
+std::size_t BTreeRope::length() const { return m_root->length(); }
+
+char BTreeRope::operator[](std::size_t index) const {
+    if (index == length()) {
+        return '\0';
+    } else if (index > length()) {
+        throw std::out_of_range{"Index out of range"};
+    } else {
+        return at(*m_root, index);
+    }
+}
+
+std::string BTreeRope::substr(std::size_t start, std::size_t length) const {
+    std::string result;
+    std::size_t total = this->length();
+    result.reserve(std::min(length, total - std::min(start, total)));
+
+    for_each_chunk(start, length,
+                   [&result](std::string_view chunk) { result += chunk; });
+
+    return result;
+}
+
+std::size_t BTreeRope::height() const { return m_root->height(); }
+
+const BTreeRope::Handle& BTreeRope::root() const { return m_root; }
+
+BTreeRope BTreeRope::insert(std::size_t index, std::string_view text) const {
+    std::vector<Handle> nodes = rope::btree::insert(m_root, index, text);
+
+    while (nodes.size() > 1) {
+        nodes = pack(nodes);
+    }
+
+    return BTreeRope{nodes.front()};
+}
+
+BTreeRope BTreeRope::append(std::string_view text) const {
+    return insert(length(), text);
+}
+
+BTreeRope BTreeRope::prepend(std::string_view text) const {
+    return insert(0, text);
+}
+
+BTreeRope BTreeRope::erase(std::size_t start, std::size_t length) const {
+    if (length == 0) {
+        return *this;
+    }
+
+    return BTreeRope{rope::btree::erase(m_root, start, length)};
+}
+
+BTreeRope BTreeRope::replace(std::size_t start, std::size_t length,
+                             std::string_view text) const {
+    return erase(start, length).insert(start, text);
+}
+
+BTreeRope BTreeRope::slice(std::size_t start, std::size_t length) const {
+    std::size_t end = std::min(start + length, this->length());
+    return erase(end, this->length() - end).erase(0, std::min(start, end));
+}
+
+std::size_t BTreeRope::find_line_start(std::size_t index) const {
+    if (index == 0) {
+        return 0;
+    }
+    if (index >= line_count()) {
+        return length();
+    }
+
+    return find_line_feed(*m_root, index - 1) + 1;
+}
+
+std::size_t BTreeRope::line_count() const {
+    return m_root->lfcnt()
+         + (length() == 0 || at(*m_root, length() - 1) != '\n');
+}
+
+std::size_t BTreeRope::line_length(std::size_t line_index) const {
+    if (line_index == line_count() - 1) {
+        return length() - find_line_start(line_index);
+    }
+
+    return find_line_start(line_index + 1) - find_line_start(line_index) - 1;
+}
+
+std::size_t BTreeRope::index_from_pos(std::size_t line_index,
+                                      std::size_t line_pos) const {
+    return find_line_start(line_index) + line_pos;
+}
+
+bool BTreeRope::operator==(const BTreeRope& other) const {
+    if (m_root == other.m_root) {
+        return true;
+    }
+    if (length() != other.length()) {
+        return false;
+    }
+
+    bool equal = true;
+    std::size_t offset = 0;
+
+    for_each_chunk([&](std::string_view chunk) {
+        if (!equal) {
+            return;
+        }
+
+        std::size_t size = chunk.size();
+        auto compare = [&](std::string_view other_chunk) {
+            equal = equal && chunk.starts_with(other_chunk);
+            chunk.remove_prefix(other_chunk.size());
+        };
+        other.for_each_chunk(offset, size, compare);
+        offset += size;
+    });
+
+    return equal;
+}
+
+bool BTreeRope::operator!=(const BTreeRope& other) const {
+    return !(*this == other);
+}
+
+std::ostream& operator<<(std::ostream& os, const BTreeRope& rope) {
+    rope.for_each_chunk([&os](std::string_view chunk) { os << chunk; });
+    return os;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "rope/btree.hpp"
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Alternative rope engine backed by a wide B-tree (rope/btree.hpp) instead
+// of Rope's binary tree. It mirrors Rope's text, line and editing interface
+// so the two can be swapped in generic code and measured against each other
+// (see src/rope/bench.cpp).
+class BTreeRope {
+private:
+    using Node = rope::btree::Node;
+
+public:
+    using Handle = rope::btree::Handle;
+
+    BTreeRope();
+    BTreeRope(std::string_view text);
+    BTreeRope(Handle root);
+
+    std::string to_string() const;
+    std::size_t length() const;
+    char operator[](std::size_t index) const;
+    std::string substr(std::size_t start, std::size_t length) const;
+
+    // Calls `visit(std::string_view)` once per leaf slice, in order.
+    template<typename Visitor>
+    void for_each_chunk(Visitor&& visit) const;
+    template<typename Visitor>
+    void for_each_chunk(std::size_t start, std::size_t length,
+                        Visitor&& visit) const;
+
+    std::size_t height() const;
+    // The tree itself, for looking at its shape.
+    const Handle& root() const;
+
+    [[nodiscard]] BTreeRope insert(std::size_t index,
+                                   std::string_view text) const;
+    [[nodiscard]] BTreeRope append(std::string_view text) const;
+    [[nodiscard]] BTreeRope prepend(std::string_view text) const;
+    [[nodiscard]] BTreeRope erase(std::size_t start, std::size_t length) const;
+    [[nodiscard]] BTreeRope replace(std::size_t start, std::size_t length,
+                                    std::string_view text) const;
+    // The rope of [start, start + length), sharing this rope's leaves.
+    BTreeRope slice(std::size_t start, std::size_t length) const;
+
+    std::size_t find_line_start(std::size_t index) const;
+    std::size_t line_count() const;
+    std::size_t line_length(std::size_t line_index) const;
+    std::size_t index_from_pos(std::size_t line_index,
+                               std::size_t line_pos) const;
+
+    bool operator==(const BTreeRope& other) const;
+    bool operator!=(const BTreeRope& other) const;
+    friend std::ostream& operator<<(std::ostream& os, const BTreeRope& rope);
+
+private:
+    Handle m_root{};
+};
+
+#include "rope/btree_rope_inl.hpp"
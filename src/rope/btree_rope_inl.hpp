@@ -0,0 +1,18 @@
+#pragma once
+
+#include "rope/btree_rope.hpp"
+
+#include "rope/btree.hpp"
+
+#include <cstddef>
+
+template<typename Visitor>
+void BTreeRope::for_each_chunk(Visitor&& visit) const {
+    rope::btree::for_each_chunk(*m_root, 0, m_root->length(), visit);
+}
+
+template<typename Visitor>
+void BTreeRope::for_each_chunk(std::size_t start, std::size_t length,
+                               Visitor&& visit) const {
+    rope::btree::for_each_chunk(*m_root, start, length, visit);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <utility>
+
+#ifdef JALEDIT_ROPE_ATOMIC_REFCOUNT
+#include <atomic>
+#endif
+
+namespace rope {
+
+// Reference count embedded in every node. It is a plain integer unless
+// JALEDIT_ROPE_ATOMIC_REFCOUNT is defined: handles to one tree must then
+// only be copied and dropped on one thread at a time, which holds as long as
+// ropes are handed between threads rather than shared by them.
+class RefCount {
+public:
+    RefCount() = default;
+    // A copied object is a new object: it starts out unreferenced.
+    RefCount(const RefCount& /* other */) {}
+    RefCount& operator=(const RefCount& /* other */) { return *this; }
+
+    void increment() { ++m_count; }
+    bool decrement() { return --m_count == 0; }
+
+private:
+#ifdef JALEDIT_ROPE_ATOMIC_REFCOUNT
+    std::atomic<std::size_t> m_count{};
+#else
+    std::size_t m_count{};
+#endif
+};
+
+// Intrusive counterpart of std::shared_ptr for types that expose a
+// `refcount()` returning a RefCount&. There is no separate control block,
+// so a handle is one pointer wide and creating a node is one allocation.
+template<typename T>
+class Ref {
+public:
+    Ref() = default;
+    Ref(std::nullptr_t) {}
+    explicit Ref(T* ptr) : m_ptr{ptr} { acquire(); }
+
+    Ref(const Ref& other) : m_ptr{other.m_ptr} { acquire(); }
+    Ref(Ref&& other) noexcept : m_ptr{std::exchange(other.m_ptr, nullptr)} {}
+
+    template<typename U>
+        requires std::convertible_to<U*, T*>
+    Ref(const Ref<U>& other) : m_ptr{other.get()} {
+        acquire();
+    }
+
+    template<typename U>
+        requires std::convertible_to<U*, T*>
+    Ref(Ref<U>&& other) : m_ptr{other.release()} {}
+
+    ~Ref() { reset(); }
+
+    Ref& operator=(Ref other) noexcept {
+        std::swap(m_ptr, other.m_ptr);
+        return *this;
+    }
+
+    T* get() const { return m_ptr; }
+    T& operator*() const { return *m_ptr; }
+    T* operator->() const { return m_ptr; }
+    explicit operator bool() const { return m_ptr != nullptr; }
+
+    void reset() {
+        if (m_ptr != nullptr && m_ptr->refcount().decrement()) {
+            delete m_ptr;
+        }
+        m_ptr = nullptr;
+    }
+
+    // Gives up ownership without touching the count.
+    T* release() { return std::exchange(m_ptr, nullptr); }
+
+    template<typename U>
+    bool operator==(const Ref<U>& other) const {
+        return m_ptr == other.get();
+    }
+    bool operator==(std::nullptr_t) const { return m_ptr == nullptr; }
+
+private:
+    T* m_ptr{};
+
+    void acquire() {
+        if (m_ptr != nullptr) {
+            m_ptr->refcount().increment();
+        }
+    }
+};
+
+template<typename T, typename... Args>
+Ref<T> make(Args&&... args) {
+    return Ref<T>{new T(std::forward<Args>(args)...)};
+}
+
+} // namespace rope
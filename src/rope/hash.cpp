@@ -0,0 +1,100 @@
+#include "rope/hash.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string_view>
+
+namespace rope::hash {
+
+namespace {
+
+__extension__ typedef unsigned __int128 uint128;
+
+constexpr std::uint64_t modulus = (std::uint64_t{1} << 61) - 1;
+constexpr std::size_t block_size = 8;
+
+std::uint64_t reduce(uint128 value) {
+    std::uint64_t result = static_cast<std::uint64_t>(value & modulus)
+                         + static_cast<std::uint64_t>(value >> 61);
+    result = (result & modulus) + (result >> 61);
+    return result >= modulus ? result - modulus : result;
+}
+
+std::uint64_t random_base() {
+    std::random_device device;
+    std::uniform_int_distribution<std::uint64_t> dist{1 << 8, modulus - 1};
+    return dist(device);
+}
+
+// Powers base^0 .. base^block_size, used to fold a whole block of bytes
+// into the running hash with a single dependent multiplication.
+struct Powers {
+    std::uint64_t base{random_base()};
+    std::array<std::uint64_t, block_size + 1> table{};
+
+    Powers() {
+        table[0] = 1;
+        for (std::size_t i = 1; i <= block_size; ++i) {
+            table[i] = multiply(table[i - 1], base);
+        }
+    }
+};
+
+const Powers& powers() {
+    static const Powers instance;
+    return instance;
+}
+
+} // namespace
+
+std::uint64_t multiply(std::uint64_t lhs, std::uint64_t rhs) {
+    return reduce(static_cast<uint128>(lhs) * rhs);
+}
+
+std::uint64_t bytes(std::string_view text) {
+    const auto& [base, table] = powers();
+    std::uint64_t result = 0;
+    std::size_t i = 0;
+
+    for (; i + block_size <= text.size(); i += block_size) {
+        uint128 block = 0;
+        for (std::size_t j = 0; j < block_size; ++j) {
+            block += static_cast<uint128>(
+                         static_cast<unsigned char>(text[i + j]))
+                   * table[block_size - 1 - j];
+        }
+        result = reduce(static_cast<uint128>(result)
+                            * table[block_size]
+                        + reduce(block));
+    }
+
+    for (; i < text.size(); ++i) {
+        result = reduce(static_cast<uint128>(result) * base
+                        + static_cast<unsigned char>(text[i]));
+    }
+
+    return result;
+}
+
+std::uint64_t power(std::size_t length) {
+    std::uint64_t result = 1;
+    std::uint64_t base = powers().base;
+
+    for (; length > 0; length >>= 1) {
+        if (length & 1) {
+            result = multiply(result, base);
+        }
+        base = multiply(base, base);
+    }
+
+    return result;
+}
+
+std::uint64_t combine(std::uint64_t left, std::uint64_t right,
+                      std::uint64_t right_power) {
+    return reduce(static_cast<uint128>(left) * right_power + right);
+}
+
+} // namespace rope::hash
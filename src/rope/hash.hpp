@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Polynomial hash modulo the Mersenne prime 2^61 - 1 with a base drawn at
+// startup. It is compositional: the hash of a concatenation follows from the
+// hashes of its parts, so a tree can hash itself bottom-up regardless of its
+// shape and equal content always hashes equally.
+namespace rope::hash {
+
+std::uint64_t bytes(std::string_view text);
+std::uint64_t power(std::size_t length);
+std::uint64_t combine(std::uint64_t left, std::uint64_t right,
+                      std::uint64_t right_power);
+std::uint64_t multiply(std::uint64_t lhs, std::uint64_t rhs);
+
+} // namespace rope::hash
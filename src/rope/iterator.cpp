@@ -0,0 +1,164 @@
+#include "rope/iterator.hpp"
+
+#include "rope/node.hpp"
+
+#include <cstddef>
+#include <string_view>
+
+namespace rope {
+
+ChunkIterator::ChunkIterator(const Node* root, std::size_t index)
+    : m_root{root} {
+    if (index >= root->length()) {
+        m_offset = root->length();
+        return;
+    }
+
+    const Node* node = root;
+
+    while (node->depth() != 0) {
+        m_path.push_back(node);
+
+        const auto& branch = static_cast<const Branch&>(*node);
+        std::size_t weight = branch.left()->length();
+
+        if (index < weight) {
+            node = branch.left().get();
+        } else {
+            index -= weight;
+            m_offset += weight;
+            node = branch.right().get();
+        }
+    }
+
+    m_path.push_back(node);
+}
+
+std::string_view ChunkIterator::operator*() const {
+    return m_path.empty() ? std::string_view{} : m_path.back()->chunk();
+}
+
+std::size_t ChunkIterator::offset() const { return m_offset; }
+
+bool ChunkIterator::at_end() const { return m_path.empty(); }
+
+ChunkIterator& ChunkIterator::operator++() {
+    if (m_path.empty()) {
+        return *this;
+    }
+
+    m_offset += m_path.back()->length();
+
+    const Node* child = m_path.back();
+    m_path.pop_back();
+
+    while (!m_path.empty()) {
+        const auto& parent = static_cast<const Branch&>(*m_path.back());
+
+        if (parent.left().get() == child) {
+            descend(parent.right().get(), true);
+            return *this;
+        }
+
+        child = m_path.back();
+        m_path.pop_back();
+    }
+
+    return *this;
+}
+
+ChunkIterator& ChunkIterator::operator--() {
+    if (m_path.empty()) {
+        if (m_root != nullptr && m_offset == m_root->length()
+            && m_offset > 0) {
+            descend(m_root, false);
+            m_offset -= m_path.back()->length();
+        }
+        return *this;
+    }
+
+    const Node* child = m_path.back();
+    m_path.pop_back();
+
+    while (!m_path.empty()) {
+        const auto& parent = static_cast<const Branch&>(*m_path.back());
+
+        if (parent.right().get() == child) {
+            descend(parent.left().get(), false);
+            m_offset -= m_path.back()->length();
+            return *this;
+        }
+
+        child = m_path.back();
+        m_path.pop_back();
+    }
+
+    m_offset = 0;
+    return *this;
+}
+
+void ChunkIterator::descend(const Node* node, bool leftmost) {
+    while (node->depth() != 0) {
+        m_path.push_back(node);
+
+        const auto& branch = static_cast<const Branch&>(*node);
+        node = leftmost ? branch.left().get() : branch.right().get();
+    }
+
+    m_path.push_back(node);
+}
+
+ByteIterator::ByteIterator(const Node* root, std::size_t index)
+    : m_chunks{root, index}, m_chunk{*m_chunks},
+      m_pos{index - m_chunks.offset()} {}
+
+char ByteIterator::operator*() const {
+    return m_pos < m_chunk.size() ? m_chunk[m_pos] : '\0';
+}
+
+std::size_t ByteIterator::index() const { return m_chunks.offset() + m_pos; }
+
+ByteIterator& ByteIterator::operator++() {
+    ++m_pos;
+
+    while (m_pos >= m_chunk.size() && !m_chunks.at_end()) {
+        ++m_chunks;
+        m_chunk = *m_chunks;
+        m_pos = 0;
+    }
+
+    return *this;
+}
+
+ByteIterator ByteIterator::operator++(int) {
+    ByteIterator old = *this;
+    ++*this;
+    return old;
+}
+
+ByteIterator& ByteIterator::operator--() {
+    if (m_pos > 0) {
+        --m_pos;
+        return *this;
+    }
+
+    do {
+        --m_chunks;
+        m_chunk = *m_chunks;
+    } while (m_chunk.empty() && !m_chunks.at_end());
+
+    m_pos = m_chunk.empty() ? 0 : m_chunk.size() - 1;
+    return *this;
+}
+
+ByteIterator ByteIterator::operator--(int) {
+    ByteIterator old = *this;
+    --*this;
+    return old;
+}
+
+bool ByteIterator::operator==(const ByteIterator& other) const {
+    return index() == other.index();
+}
+
+} // namespace rope
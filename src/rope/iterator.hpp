@@ -0,0 +1,67 @@
+#pragma once
+
+#include "rope/node.hpp"
+
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+#include <vector>
+
+namespace rope {
+
+// Walks the leaves of a tree in order, keeping the path from the root so
+// that stepping to a neighbouring leaf costs amortized O(1) instead of a
+// fresh descent. The iterator borrows the tree: the rope it was created
+// from has to outlive it.
+class ChunkIterator {
+public:
+    ChunkIterator() = default;
+    ChunkIterator(const Node* root, std::size_t index);
+
+    // The leaf under the iterator, empty once it has run past either end.
+    std::string_view operator*() const;
+    // Byte offset of the current leaf from the start of the tree.
+    std::size_t offset() const;
+    bool at_end() const;
+
+    ChunkIterator& operator++();
+    ChunkIterator& operator--();
+
+private:
+    const Node* m_root{};
+    std::vector<const Node*> m_path{};
+    std::size_t m_offset{};
+
+    void descend(const Node* node, bool leftmost);
+};
+
+// Bidirectional byte iterator on top of ChunkIterator. Dereferencing the
+// end position yields '\0', matching Rope::operator[].
+class ByteIterator {
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const char*;
+    using reference = char;
+
+    ByteIterator() = default;
+    ByteIterator(const Node* root, std::size_t index);
+
+    char operator*() const;
+    std::size_t index() const;
+
+    ByteIterator& operator++();
+    ByteIterator operator++(int);
+    ByteIterator& operator--();
+    ByteIterator operator--(int);
+
+    bool operator==(const ByteIterator& other) const;
+
+private:
+    ChunkIterator m_chunks{};
+    std::string_view m_chunk{};
+    std::size_t m_pos{};
+};
+
+} // namespace rope
@@ -0,0 +1,63 @@
+#include "rope/mapping.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rope {
+
+Mapping::Mapping(std::string_view filename) {
+    m_fd = open(std::string{filename}.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd == -1) {
+        throw std::runtime_error{"Could not open file"};
+    }
+
+    struct stat sb;
+
+    if (fstat(m_fd, &sb) == -1) {
+        close(m_fd);
+        throw std::runtime_error{"Could not get file size"};
+    }
+
+    m_size = sb.st_size;
+
+    if (m_size == 0) {
+        return;
+    }
+
+    void* map = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+
+    if (map == MAP_FAILED) {
+        close(m_fd);
+        throw std::runtime_error{"Could not mmap file"};
+    }
+
+    m_data = static_cast<const char*>(map);
+}
+
+Mapping::~Mapping() {
+    if (m_data != nullptr) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+    close(m_fd);
+}
+
+std::string_view Mapping::view() const { return {m_data, m_size}; }
+
+int Mapping::fd() const { return m_fd; }
+
+bool Mapping::contains(std::string_view text) const {
+    return m_data != nullptr
+        && std::greater_equal<const char*>{}(text.data(), m_data)
+        && std::less_equal<const char*>{}(text.data() + text.size(),
+                                          m_data + m_size);
+}
+
+} // namespace rope
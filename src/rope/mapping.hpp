@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+namespace rope {
+
+// A read-only, private mapping of a whole file. Leaves that point into the
+// mapping share ownership of it, so the pages stay valid for as long as any
+// rope still references them. The file stays open as well, so its contents
+// can still be copied in the kernel after the name has been replaced.
+class Mapping {
+public:
+    using Handle = std::shared_ptr<const Mapping>;
+
+    Mapping(std::string_view filename);
+    Mapping(const Mapping& other) = delete;
+    Mapping& operator=(const Mapping& other) = delete;
+    ~Mapping();
+
+    std::string_view view() const;
+    int fd() const;
+    // Whether `text` lies within the mapping.
+    bool contains(std::string_view text) const;
+
+private:
+    int m_fd{-1};
+    const char* m_data{};
+    std::size_t m_size{};
+};
+
+} // namespace rope
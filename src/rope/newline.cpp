@@ -0,0 +1,145 @@
+#include "rope/newline.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JALEDIT_NEWLINE_X86
+#endif
+
+namespace rope::newline {
+
+namespace {
+
+// Every scanner counts the line feeds in `text` and, when `out` is not
+// null, also stores their offsets there.
+using Scanner = std::size_t (*)(std::string_view text, std::uint32_t* out);
+
+std::size_t scan_scalar(std::string_view text, std::uint32_t* out) {
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+    std::size_t count = 0;
+
+    for (const char* it = begin; it < end; ++it) {
+        it = static_cast<const char*>(std::memchr(it, '\n', end - it));
+        if (it == nullptr) {
+            break;
+        }
+        if (out != nullptr) {
+            out[count] = static_cast<std::uint32_t>(it - begin);
+        }
+        ++count;
+    }
+
+    return count;
+}
+
+#ifdef JALEDIT_NEWLINE_X86
+
+// Stores the offsets of the bits set in `mask`, which covers the block
+// starting at `base`.
+inline std::uint32_t* emit(std::uint32_t mask, std::uint32_t base,
+                           std::uint32_t* out) {
+    while (mask != 0) {
+        *out++ = base + static_cast<std::uint32_t>(__builtin_ctz(mask));
+        mask &= mask - 1;
+    }
+    return out;
+}
+
+std::size_t scan_sse2(std::string_view text, std::uint32_t* out) {
+    const char* data = text.data();
+    const __m128i newline = _mm_set1_epi8('\n');
+    std::size_t count = 0;
+    std::size_t i = 0;
+
+    for (; i + 16 <= text.size(); i += 16) {
+        __m128i block
+            = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        auto mask = static_cast<std::uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+
+        if (out != nullptr) {
+            emit(mask, static_cast<std::uint32_t>(i), out + count);
+        }
+        count += __builtin_popcount(mask);
+    }
+
+    std::size_t tail = scan_scalar(text.substr(i), out ? out + count : out);
+    if (out != nullptr) {
+        for (std::size_t j = count; j < count + tail; ++j) {
+            out[j] += static_cast<std::uint32_t>(i);
+        }
+    }
+
+    return count + tail;
+}
+
+[[gnu::target("avx2")]] std::size_t scan_avx2(std::string_view text,
+                                              std::uint32_t* out) {
+    const char* data = text.data();
+    const __m256i newline = _mm256_set1_epi8('\n');
+    std::size_t count = 0;
+    std::size_t i = 0;
+
+    for (; i + 32 <= text.size(); i += 32) {
+        __m256i block
+            = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        auto mask = static_cast<std::uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)));
+
+        if (out != nullptr) {
+            emit(mask, static_cast<std::uint32_t>(i), out + count);
+        }
+        count += __builtin_popcount(mask);
+    }
+
+    std::size_t tail = scan_sse2(text.substr(i), out ? out + count : out);
+    if (out != nullptr) {
+        for (std::size_t j = count; j < count + tail; ++j) {
+            out[j] += static_cast<std::uint32_t>(i);
+        }
+    }
+
+    return count + tail;
+}
+
+#endif
+
+Scanner select_scanner() {
+#ifdef JALEDIT_NEWLINE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return scan_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return scan_sse2;
+    }
+#endif
+    return scan_scalar;
+}
+
+Scanner scanner() {
+    static const Scanner selected = select_scanner();
+    return selected;
+}
+
+} // namespace
+
+Positions index(std::string_view text) {
+    // Counting first sizes the result exactly; leaves are small enough that
+    // the second pass reads the text back from cache.
+    Scanner scan = scanner();
+    Positions positions(scan(text, nullptr));
+
+    if (!positions.empty()) {
+        scan(text, positions.data());
+    }
+
+    return positions;
+}
+
+} // namespace rope::newline
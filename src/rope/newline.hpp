@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Vectorized line feed scanning for leaf construction. The widest
+// instruction set the CPU supports (AVX2, SSE2, or none) is picked once at
+// startup.
+namespace rope::newline {
+
+// Offsets of the line feeds within a leaf. Leaves are far shorter than
+// 4 GiB, so 32 bits per line are enough.
+using Positions = std::vector<std::uint32_t>;
+
+// Offsets of every line feed in `text`, in order. The result is sized
+// exactly, without spare capacity.
+Positions index(std::string_view text);
+
+} // namespace rope::newline
@@ -1,6 +1,9 @@
 #include "rope/node.hpp"
 
+#include "rope/hash.hpp"
+
 #include <cstddef>
+#include <cstdint>
 
 namespace rope {
 
@@ -17,4 +20,28 @@ std::size_t Node::depth() const { return m_depth; }
 
 std::size_t Node::lfcnt() const { return m_lfcnt; }
 
+std::uint64_t Node::hash() const {
+    if (m_hashed) {
+        return m_hash;
+    }
+
+    if (m_depth == 0) {
+        m_hash = hash::bytes(chunk());
+        m_power = hash::power(m_length);
+    } else {
+        const auto& branch = static_cast<const Branch&>(*this);
+        const Node& left = *branch.left();
+        const Node& right = *branch.right();
+
+        std::uint64_t left_hash = left.hash();
+        std::uint64_t right_hash = right.hash();
+
+        m_hash = hash::combine(left_hash, right_hash, right.m_power);
+        m_power = hash::multiply(left.m_power, right.m_power);
+    }
+
+    m_hashed = true;
+    return m_hash;
+}
+
 } // namespace rope
\ No newline at end of file
@@ -1,8 +1,15 @@
 #pragma once
 
+#include "rope/handle.hpp"
+#include "rope/mapping.hpp"
+#include "rope/newline.hpp"
+#include "rope/pool.hpp"
+
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -10,7 +17,7 @@ namespace rope {
 
 class Node {
 public:
-    using Handle = std::shared_ptr<Node>;
+    using Handle = Ref<Node>;
 
     virtual char operator[](std::size_t index) const = 0;
     virtual std::string substr(std::size_t start, std::size_t length) const = 0;
@@ -18,12 +25,24 @@ public:
     virtual std::pair<Handle, Handle> split(std::size_t index) const = 0;
     virtual std::vector<Handle> leaves() const = 0;
     virtual std::size_t find_line_feed(std::size_t index) const = 0;
+    // The bytes held by a leaf; branches have no bytes of their own.
+    virtual std::string_view chunk() const = 0;
     virtual ~Node() = default;
 
+    static void* operator new(std::size_t size) { return pool::allocate(size); }
+    static void operator delete(void* ptr, std::size_t size) {
+        pool::deallocate(ptr, size);
+    }
+
+    RefCount& refcount() const { return m_refcount; }
+
     std::size_t find_line_start(std::size_t line_index) const;
     std::size_t length() const;
     std::size_t depth() const;
     std::size_t lfcnt() const;
+    // Hash of the content (see rope/hash.hpp), computed on first use and
+    // cached in the node. Not synchronized: call it from one thread.
+    std::uint64_t hash() const;
 
 protected:
     std::size_t m_depth{};
@@ -33,11 +52,24 @@ protected:
 
     std::size_t m_lfcnt;
     std::size_t m_lfweight{};
+
+    mutable RefCount m_refcount{};
+
+    mutable std::uint64_t m_hash{};
+    mutable std::uint64_t m_power{};
+    mutable bool m_hashed{};
 };
 
 class Leaf : public Node {
 public:
-    Leaf(const std::string& text);
+    // Heap leaves are kept within these bounds: edits that fit are applied
+    // by rewriting the leaf in place (on a copy), leaves shorter than
+    // min_length are merged into a neighbour when joined, and text longer
+    // than max_length is cut into several leaves.
+    static constexpr std::size_t min_length = 512;
+    static constexpr std::size_t max_length = 4096;
+
+    Leaf(std::string text);
     ~Leaf() override = default;
 
     char operator[](std::size_t index) const override;
@@ -47,6 +79,7 @@ public:
     split(std::size_t index) const override;
     std::vector<Node::Handle> leaves() const override;
     std::size_t find_line_feed(std::size_t index) const override;
+    std::string_view chunk() const override;
 
 private:
     using Node::m_depth;
@@ -58,7 +91,39 @@ private:
     using Node::m_lfweight;
 
     std::string m_text{};
-    std::vector<std::size_t> m_lfpos{};
+    newline::Positions m_lfpos{};
+};
+
+// A leaf whose bytes live in a file mapping instead of on the heap. Splitting
+// it only narrows the view, so untouched regions of a file are never copied.
+class MappedLeaf : public Node {
+public:
+    MappedLeaf(Mapping::Handle mapping, std::string_view text);
+    MappedLeaf(Mapping::Handle mapping, std::string_view text,
+               newline::Positions lfpos);
+    ~MappedLeaf() override = default;
+
+    char operator[](std::size_t index) const override;
+    std::string substr(std::size_t start, std::size_t length) const override;
+    std::string to_string() const override;
+    std::pair<Node::Handle, Node::Handle>
+    split(std::size_t index) const override;
+    std::vector<Node::Handle> leaves() const override;
+    std::size_t find_line_feed(std::size_t index) const override;
+    std::string_view chunk() const override;
+
+private:
+    using Node::m_depth;
+
+    using Node::m_length;
+    using Node::m_weight;
+
+    using Node::m_lfcnt;
+    using Node::m_lfweight;
+
+    Mapping::Handle m_mapping{};
+    std::string_view m_text{};
+    newline::Positions m_lfpos{};
 };
 
 class Branch : public Node {
@@ -74,6 +139,10 @@ public:
     split(std::size_t index) const override;
     std::vector<Node::Handle> leaves() const override;
     std::size_t find_line_feed(std::size_t index) const override;
+    std::string_view chunk() const override;
+
+    const Node::Handle& left() const;
+    const Node::Handle& right() const;
 
 private:
     using Node::m_depth;
@@ -88,4 +157,18 @@ private:
     Node::Handle m_right{};
 };
 
-} // namespace rope
\ No newline at end of file
+// Concatenates two trees, restoring the AVL height invariant along the seam
+// with at most O(|depth(left) - depth(right)|) rotations. Empty operands are
+// dropped, and an operand that is a single short leaf is merged into the
+// adjacent leaf of the other tree when both fit in one leaf.
+Node::Handle join(const Node::Handle& left, const Node::Handle& right);
+
+// Calls `visit` with a string_view of every leaf slice overlapping
+// [start, start + length), in order. Nothing is copied or allocated.
+template<typename Visitor>
+void for_each_chunk(const Node& node, std::size_t start, std::size_t length,
+                    Visitor& visit);
+
+} // namespace rope
+
+#include "rope/node_inl.hpp"
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace rope {
@@ -31,25 +32,16 @@ char Branch::operator[](std::size_t index) const {
 }
 
 std::string Branch::substr(std::size_t start, std::size_t length) const {
-    if (start >= m_weight) {
-        return m_right ? m_right->substr(start - m_weight, length) : "";
-    }
-
-    std::string result = m_left ? m_left->substr(start, length) : "";
+    std::string result;
+    result.reserve(std::min(length, m_length - std::min(start, m_length)));
 
-    if (start + length > m_weight) {
-        std::size_t offset = m_weight - start;
-        result += m_right ? m_right->substr(0, length - offset) : "";
-    }
+    auto append = [&result](std::string_view chunk) { result += chunk; };
+    for_each_chunk(*this, start, length, append);
 
     return result;
 }
 
-std::string Branch::to_string() const {
-    std::string result = m_left ? m_left->to_string() : "";
-    result += m_right ? m_right->to_string() : "";
-    return result;
-}
+std::string Branch::to_string() const { return substr(0, m_length); }
 
 std::pair<Node::Handle, Node::Handle> Branch::split(std::size_t index) const {
     if (index == m_weight) {
@@ -60,19 +52,13 @@ std::pair<Node::Handle, Node::Handle> Branch::split(std::size_t index) const {
         const auto& [lsplit_left, lsplit_right]
             = m_left ? m_left->split(index) : std::pair{nullptr, nullptr};
 
-        return {
-            lsplit_left,
-            std::make_shared<Branch>(lsplit_right, m_right),
-        };
+        return {lsplit_left, join(lsplit_right, m_right)};
     } else {
         const auto& [rsplit_left, rsplit_right]
             = m_right ? m_right->split(index - m_weight)
                       : std::pair{nullptr, nullptr};
 
-        return {
-            std::make_shared<Branch>(m_left, rsplit_left),
-            rsplit_right,
-        };
+        return {join(m_left, rsplit_left), rsplit_right};
     }
 }
 
@@ -100,4 +86,132 @@ std::size_t Branch::find_line_feed(std::size_t index) const {
     }
 }
 
+std::string_view Branch::chunk() const { return {}; }
+
+const Node::Handle& Branch::left() const { return m_left; }
+
+const Node::Handle& Branch::right() const { return m_right; }
+
+namespace {
+
+Node::Handle make_branch(const Node::Handle& left, const Node::Handle& right) {
+    return make<Branch>(left, right);
+}
+
+const Branch& as_branch(const Node::Handle& node) {
+    return static_cast<const Branch&>(*node);
+}
+
+// Joins when `left` is at least two levels deeper than `right`: walk down the
+// right spine of `left` until the heights match, then rotate on the way up.
+Node::Handle join_right(const Node::Handle& left, const Node::Handle& right) {
+    const auto& outer = as_branch(left).left();
+    const auto& inner = as_branch(left).right();
+
+    if (inner->depth() <= right->depth() + 1) {
+        if (std::max(inner->depth(), right->depth()) <= outer->depth()) {
+            return make_branch(outer, make_branch(inner, right));
+        }
+
+        const auto& pivot = as_branch(inner);
+        return make_branch(make_branch(outer, pivot.left()),
+                           make_branch(pivot.right(), right));
+    }
+
+    Node::Handle joined = join_right(inner, right);
+    if (joined->depth() <= outer->depth() + 1) {
+        return make_branch(outer, joined);
+    }
+
+    return make_branch(make_branch(outer, as_branch(joined).left()),
+                       as_branch(joined).right());
+}
+
+// Mirror image of join_right.
+Node::Handle join_left(const Node::Handle& left, const Node::Handle& right) {
+    const auto& outer = as_branch(right).right();
+    const auto& inner = as_branch(right).left();
+
+    if (inner->depth() <= left->depth() + 1) {
+        if (std::max(inner->depth(), left->depth()) <= outer->depth()) {
+            return make_branch(make_branch(left, inner), outer);
+        }
+
+        const auto& pivot = as_branch(inner);
+        return make_branch(make_branch(left, pivot.left()),
+                           make_branch(pivot.right(), outer));
+    }
+
+    Node::Handle joined = join_left(left, inner);
+    if (joined->depth() <= outer->depth() + 1) {
+        return make_branch(joined, outer);
+    }
+
+    return make_branch(as_branch(joined).left(),
+                       make_branch(as_branch(joined).right(), outer));
+}
+
+// Appends a short leaf to the rightmost leaf of `node` when the result still
+// fits in a single leaf. Depths are unchanged, so only the spine is copied.
+Node::Handle append_small(const Node::Handle& node, const Node::Handle& leaf) {
+    if (node->depth() == 0) {
+        if (node->length() + leaf->length() > Leaf::max_length) {
+            return nullptr;
+        }
+        return make<Leaf>(node->to_string() + leaf->to_string());
+    }
+
+    const auto& branch = as_branch(node);
+    Node::Handle merged = append_small(branch.right(), leaf);
+    return merged ? make_branch(branch.left(), merged) : nullptr;
+}
+
+// Mirror image of append_small.
+Node::Handle prepend_small(const Node::Handle& leaf, const Node::Handle& node) {
+    if (node->depth() == 0) {
+        if (node->length() + leaf->length() > Leaf::max_length) {
+            return nullptr;
+        }
+        return make<Leaf>(leaf->to_string() + node->to_string());
+    }
+
+    const auto& branch = as_branch(node);
+    Node::Handle merged = prepend_small(leaf, branch.left());
+    return merged ? make_branch(merged, branch.right()) : nullptr;
+}
+
+} // namespace
+
+Node::Handle join(const Node::Handle& left, const Node::Handle& right) {
+    if (!left || left->length() == 0) {
+        return right ? right : left;
+    }
+
+    if (!right || right->length() == 0) {
+        return left;
+    }
+
+    if (right->depth() == 0 && right->length() < Leaf::min_length) {
+        if (Node::Handle merged = append_small(left, right)) {
+            return merged;
+        }
+    }
+
+    if (left->depth() == 0 && left->length() < Leaf::min_length) {
+        if (Node::Handle merged = prepend_small(left, right)) {
+            return merged;
+        }
+    }
+
+    if (left->depth() > right->depth() + 1) {
+        return join_right(left, right);
+    }
+
+    if (right->depth() > left->depth() + 1) {
+        return join_left(left, right);
+    }
+
+    return make_branch(left, right);
+}
+
 } // namespace rope
\ No newline at end of file
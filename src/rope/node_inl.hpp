@@ -0,0 +1,40 @@
+#pragma once
+
+#include "rope/node.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+
+namespace rope {
+
+template<typename Visitor>
+void for_each_chunk(const Node& node, std::size_t start, std::size_t length,
+                    Visitor& visit) {
+    if (length == 0) {
+        return;
+    }
+
+    if (node.depth() == 0) {
+        visit(node.chunk().substr(start, length));
+        return;
+    }
+
+    const auto& branch = static_cast<const Branch&>(node);
+    std::size_t weight = branch.left()->length();
+
+    if (start < weight) {
+        std::size_t left_length = std::min(length, weight - start);
+        for_each_chunk(*branch.left(), start, left_length, visit);
+        length -= left_length;
+        start = 0;
+    } else {
+        start -= weight;
+    }
+
+    if (length > 0) {
+        for_each_chunk(*branch.right(), start, length, visit);
+    }
+}
+
+} // namespace rope
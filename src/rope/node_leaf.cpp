@@ -2,21 +2,16 @@
 
 #include <cstddef>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
 namespace rope {
 
-Leaf::Leaf(const std::string& text) : m_text{text} {
-    m_weight = text.length();
-    m_length = text.length();
-
-    for (std::size_t i = 0; i < m_length; ++i) {
-        if (m_text[i] == '\n') {
-            m_lfpos.push_back(i);
-        }
-    }
-
+Leaf::Leaf(std::string text)
+    : m_text{std::move(text)}, m_lfpos{newline::index(m_text)} {
+    m_weight = m_text.length();
+    m_length = m_text.length();
     m_lfweight = m_lfcnt = m_lfpos.size();
 }
 
@@ -30,17 +25,19 @@ std::string Leaf::to_string() const { return m_text; }
 
 std::pair<Node::Handle, Node::Handle> Leaf::split(std::size_t index) const {
     return {
-        std::make_shared<Leaf>(m_text.substr(0, index)),
-        std::make_shared<Leaf>(m_text.substr(index)),
+        make<Leaf>(m_text.substr(0, index)),
+        make<Leaf>(m_text.substr(index)),
     };
 }
 
 std::vector<Node::Handle> Leaf::leaves() const {
-    return {std::make_shared<Leaf>(*this)};
+    return {make<Leaf>(*this)};
 }
 
 std::size_t Leaf::find_line_feed(std::size_t index) const {
     return m_lfpos.at(index);
 }
 
+std::string_view Leaf::chunk() const { return m_text; }
+
 } // namespace rope
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include "rope/node.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace rope {
+
+MappedLeaf::MappedLeaf(Mapping::Handle mapping, std::string_view text)
+    : MappedLeaf{std::move(mapping), text, newline::index(text)} {}
+
+MappedLeaf::MappedLeaf(Mapping::Handle mapping, std::string_view text,
+                       newline::Positions lfpos)
+    : m_mapping{std::move(mapping)}, m_text{text}, m_lfpos{std::move(lfpos)} {
+    m_weight = m_text.length();
+    m_length = m_text.length();
+    m_lfweight = m_lfcnt = m_lfpos.size();
+}
+
+char MappedLeaf::operator[](std::size_t index) const { return m_text[index]; }
+
+std::string MappedLeaf::substr(std::size_t start, std::size_t length) const {
+    return std::string{m_text.substr(start, length)};
+}
+
+std::string MappedLeaf::to_string() const { return std::string{m_text}; }
+
+std::pair<Node::Handle, Node::Handle>
+MappedLeaf::split(std::size_t index) const {
+    auto mid = std::lower_bound(m_lfpos.begin(), m_lfpos.end(), index);
+
+    newline::Positions right_lfpos;
+    right_lfpos.reserve(m_lfpos.end() - mid);
+    for (auto it = mid; it != m_lfpos.end(); ++it) {
+        right_lfpos.push_back(static_cast<std::uint32_t>(*it - index));
+    }
+
+    return {
+        make<MappedLeaf>(m_mapping, m_text.substr(0, index),
+                         newline::Positions(m_lfpos.begin(), mid)),
+        make<MappedLeaf>(m_mapping, m_text.substr(index),
+                         std::move(right_lfpos)),
+    };
+}
+
+std::vector<Node::Handle> MappedLeaf::leaves() const {
+    return {make<MappedLeaf>(*this)};
+}
+
+std::size_t MappedLeaf::find_line_feed(std::size_t index) const {
+    return m_lfpos.at(index);
+}
+
+std::string_view MappedLeaf::chunk() const { return m_text; }
+
+} // namespace rope
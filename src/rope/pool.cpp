@@ -0,0 +1,147 @@
+#include "rope/pool.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace rope::pool {
+
+namespace {
+
+constexpr std::size_t granularity = 16;
+constexpr std::size_t class_count = 16;
+constexpr std::size_t max_size = granularity * class_count;
+constexpr std::size_t slab_size = 64 * 1024;
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+using FreeLists = std::array<FreeBlock*, class_count>;
+
+std::atomic<std::size_t> allocation_count{};
+
+// Blocks left over by threads that have exited. Slabs themselves are never
+// returned, since blocks from one slab may be owned by any thread.
+struct Orphans {
+    std::mutex mutex;
+    FreeLists lists{};
+};
+
+Orphans& orphans() {
+    static auto* instance = new Orphans;
+    return *instance;
+}
+
+// Set once the calling thread's cache has been destroyed, so that nodes
+// released during thread or program teardown go straight to the orphans.
+thread_local bool cache_retired = false;
+
+struct Cache {
+    FreeLists lists{};
+    char* bump{};
+    char* bump_end{};
+
+    Cache() = default;
+    Cache(const Cache& other) = delete;
+    Cache& operator=(const Cache& other) = delete;
+
+    ~Cache() {
+        auto& shared = orphans();
+        std::lock_guard lock{shared.mutex};
+
+        for (std::size_t i = 0; i < class_count; ++i) {
+            while (lists[i] != nullptr) {
+                FreeBlock* block = lists[i];
+                lists[i] = block->next;
+                block->next = shared.lists[i];
+                shared.lists[i] = block;
+            }
+        }
+
+        cache_retired = true;
+    }
+};
+
+thread_local Cache cache;
+
+std::size_t size_class(std::size_t size) {
+    return (size + granularity - 1) / granularity - 1;
+}
+
+} // namespace
+
+void* allocate(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (size > max_size) {
+        return ::operator new(size);
+    }
+
+    std::size_t index = size_class(size);
+    std::size_t block_size = (index + 1) * granularity;
+
+    if (cache_retired) {
+        auto& shared = orphans();
+        std::lock_guard lock{shared.mutex};
+
+        if (FreeBlock* block = shared.lists[index]) {
+            shared.lists[index] = block->next;
+            return block;
+        }
+        return ::operator new(block_size);
+    }
+
+    FreeBlock*& head = cache.lists[index];
+
+    if (head == nullptr) {
+        auto& shared = orphans();
+        std::lock_guard lock{shared.mutex};
+        head = std::exchange(shared.lists[index], nullptr);
+    }
+
+    if (head != nullptr) {
+        FreeBlock* block = head;
+        head = block->next;
+        return block;
+    }
+
+    if (cache.bump == nullptr
+        || static_cast<std::size_t>(cache.bump_end - cache.bump)
+               < block_size) {
+        cache.bump = static_cast<char*>(::operator new(slab_size));
+        cache.bump_end = cache.bump + slab_size;
+    }
+
+    void* block = cache.bump;
+    cache.bump += block_size;
+    return block;
+}
+
+void deallocate(void* ptr, std::size_t size) noexcept {
+    if (size > max_size) {
+        ::operator delete(ptr);
+        return;
+    }
+
+    std::size_t index = size_class(size);
+
+    if (cache_retired) {
+        auto& shared = orphans();
+        std::lock_guard lock{shared.mutex};
+        shared.lists[index] = new (ptr) FreeBlock{shared.lists[index]};
+        return;
+    }
+
+    FreeBlock*& head = cache.lists[index];
+    head = new (ptr) FreeBlock{head};
+}
+
+std::size_t allocations() {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+} // namespace rope::pool
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+// Size-class allocator backing rope nodes. Blocks are carved out of large
+// slabs and recycled through per-thread free lists, so creating and dropping
+// nodes never reaches the general-purpose heap in the steady state. Blocks
+// freed by a thread that exits are handed to the next thread that runs dry.
+namespace rope::pool {
+
+void* allocate(std::size_t size);
+void deallocate(void* ptr, std::size_t size) noexcept;
+
+// Number of node allocations served since startup, across all threads.
+std::size_t allocations();
+
+} // namespace rope::pool
@@ -2,14 +2,278 @@
 
 #include "rope/utils.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <ostream>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
 using namespace rope;
 
+namespace {
+
+// Applies an insertion by rewriting the single leaf that receives it, which
+// copies at most Leaf::max_length bytes plus the path from the root. Returns
+// nullptr when no leaf at `index` has room for the text.
+Node::Handle insert_in_leaf(const Node::Handle& node, std::size_t index,
+                            const std::string& text) {
+    if (node->depth() == 0) {
+        if (node->length() + text.length() > Leaf::max_length) {
+            return nullptr;
+        }
+
+        std::string result = node->to_string();
+        result.insert(index, text);
+        return make<Leaf>(std::move(result));
+    }
+
+    const auto& branch = static_cast<const Branch&>(*node);
+    std::size_t weight = branch.left()->length();
+
+    if (index <= weight) {
+        if (auto left = insert_in_leaf(branch.left(), index, text)) {
+            return make<Branch>(left, branch.right());
+        }
+
+        if (index < weight) {
+            return nullptr;
+        }
+    }
+
+    if (auto right = insert_in_leaf(branch.right(), index - weight, text)) {
+        return make<Branch>(branch.left(), right);
+    }
+
+    return nullptr;
+}
+
+// Counterpart of insert_in_leaf for ranges inside one short leaf. Ranges that
+// span leaves, empty a leaf, or fall in a large (mapped) leaf are left to
+// split and join, which does not copy any text.
+Node::Handle erase_in_leaf(const Node::Handle& node, std::size_t start,
+                           std::size_t length) {
+    if (node->depth() == 0) {
+        if (node->length() > Leaf::max_length || length >= node->length()) {
+            return nullptr;
+        }
+
+        std::string result = node->to_string();
+        result.erase(start, length);
+        return make<Leaf>(std::move(result));
+    }
+
+    const auto& branch = static_cast<const Branch&>(*node);
+    std::size_t weight = branch.left()->length();
+
+    if (start + length <= weight) {
+        if (auto left = erase_in_leaf(branch.left(), start, length)) {
+            return make<Branch>(left, branch.right());
+        }
+    } else if (start >= weight) {
+        auto right = erase_in_leaf(branch.right(), start - weight, length);
+        if (right) {
+            return make<Branch>(branch.left(), right);
+        }
+    }
+
+    return nullptr;
+}
+
+// Compares two trees leaf slice against leaf slice, advancing whichever
+// side runs out first, so neither is flattened into a string.
+bool same_chunks(const Node* lhs_root, const Node* rhs_root) {
+    ChunkIterator lhs{lhs_root, 0};
+    ChunkIterator rhs{rhs_root, 0};
+    std::string_view lhs_chunk = *lhs;
+    std::string_view rhs_chunk = *rhs;
+
+    while (!lhs.at_end() && !rhs.at_end()) {
+        std::size_t count = std::min(lhs_chunk.size(), rhs_chunk.size());
+
+        if (lhs_chunk.substr(0, count) != rhs_chunk.substr(0, count)) {
+            return false;
+        }
+
+        lhs_chunk.remove_prefix(count);
+        rhs_chunk.remove_prefix(count);
+
+        if (lhs_chunk.empty()) {
+            lhs_chunk = *++lhs;
+        }
+        if (rhs_chunk.empty()) {
+            rhs_chunk = *++rhs;
+        }
+    }
+
+    return true;
+}
+
+// Subtrees shared between the two ropes are equal by identity and content
+// hashes rule out most mismatches without touching any text. Only subtrees
+// with equal hashes but different shapes are compared byte by byte.
+bool same_content(const Node::Handle& lhs, const Node::Handle& rhs) {
+    if (lhs == rhs) {
+        return true;
+    }
+
+    if (lhs->length() != rhs->length() || lhs->hash() != rhs->hash()) {
+        return false;
+    }
+
+    if (lhs->depth() != 0 && rhs->depth() != 0) {
+        const auto& lhs_branch = static_cast<const Branch&>(*lhs);
+        const auto& rhs_branch = static_cast<const Branch&>(*rhs);
+
+        if (lhs_branch.left()->length() == rhs_branch.left()->length()) {
+            return same_content(lhs_branch.left(), rhs_branch.left())
+                && same_content(lhs_branch.right(), rhs_branch.right());
+        }
+    }
+
+    return same_chunks(lhs.get(), rhs.get());
+}
+
+} // namespace
+
 Rope::Rope() : Rope{""} {}
 
-Rope::Rope(const std::string& text) : m_root{std::make_shared<Leaf>(text)} {}
+Rope::Rope(const std::string& text) {
+    if (text.length() <= Leaf::max_length) {
+        m_root = make<Leaf>(text);
+        return;
+    }
+
+    // The fewest leaves that hold the text, all of about the same length,
+    // so that the last one is not left short.
+    std::size_t count
+        = (text.length() + Leaf::max_length - 1) / Leaf::max_length;
+    std::vector<Node::Handle> leaves;
+    leaves.reserve(count);
+
+    for (std::size_t i = 0; i < count; ++i) {
+        std::size_t start = text.length() * i / count;
+        std::size_t end = text.length() * (i + 1) / count;
+        leaves.push_back(make<Leaf>(text.substr(start, end - start)));
+    }
+
+    m_root = leaves_merge(leaves, 0, leaves.size());
+}
 
 Rope::Rope(Handle root) : m_root{std::move(root)} {}
 
+Rope Rope::from_chunks(std::string_view text, std::size_t chunk_size) {
+    if (text.empty()) {
+        return Rope{};
+    }
+
+    std::vector<Node::Handle> leaves;
+    leaves.reserve((text.size() + chunk_size - 1) / chunk_size);
+
+    for (std::size_t i = 0; i < text.size(); i += chunk_size) {
+        leaves.push_back(
+            make<Leaf>(std::string{text.substr(i, chunk_size)}));
+    }
+
+    return leaves_merge(leaves);
+}
+
+Rope Rope::from_mapping(const Mapping::Handle& mapping,
+                        std::size_t chunk_size,
+                        std::atomic<std::size_t>* progress,
+                        std::stop_token stop) {
+    std::string_view text = mapping->view();
+
+    if (text.empty()) {
+        return Rope{};
+    }
+
+    std::size_t leaf_count = (text.size() + chunk_size - 1) / chunk_size;
+    std::size_t cores = std::max(std::thread::hardware_concurrency(), 1U);
+    std::size_t workers
+        = std::min(cores, leaf_count / min_leaves_per_worker);
+
+    if (workers <= 1) {
+        Node::Handle root = mapped_subtree(mapping, chunk_size, 0, leaf_count,
+                                           progress, stop);
+        if (!root) {
+            return Rope{};
+        }
+
+        Rope rope{root};
+        rope.hash();
+        return rope;
+    }
+
+    // Each worker indexes a contiguous run of chunks into a balanced subtree
+    // of its own. The subtrees can differ in depth by one, which a plain
+    // merge would compound, so they are joined like any other trees.
+    std::vector<Node::Handle> subtrees(workers);
+    std::vector<std::exception_ptr> errors(workers);
+
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(workers);
+
+        for (std::size_t i = 0; i < workers; ++i) {
+            std::size_t first = leaf_count * i / workers;
+            std::size_t last = leaf_count * (i + 1) / workers;
+
+            threads.emplace_back([&, i, first, last] {
+                try {
+                    subtrees[i] = mapped_subtree(mapping, chunk_size, first,
+                                                 last, progress, stop);
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            });
+        }
+    }
+
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    if (stop.stop_requested()) {
+        return Rope{};
+    }
+
+    Node::Handle root = subtrees.front();
+    for (std::size_t i = 1; i < subtrees.size(); ++i) {
+        root = join(root, subtrees[i]);
+    }
+
+    // The leaves are hashed already; this only combines their hashes.
+    Rope rope{root};
+    rope.hash();
+    return rope;
+}
+
+Rope Rope::from_view(const Mapping::Handle& mapping, std::string_view text,
+                     std::size_t chunk_size) {
+    if (text.empty()) {
+        return Rope{};
+    }
+
+    std::vector<Node::Handle> leaves;
+    leaves.reserve((text.size() + chunk_size - 1) / chunk_size);
+
+    for (std::size_t i = 0; i < text.size(); i += chunk_size) {
+        leaves.push_back(
+            make<MappedLeaf>(mapping, text.substr(i, chunk_size)));
+    }
+
+    return leaves_merge(leaves);
+}
+
 std::string Rope::to_string() const { return m_root->to_string(); }
 
 std::size_t Rope::length() const { return m_root->length(); }
@@ -28,6 +292,41 @@ std::string Rope::substr(std::size_t start, std::size_t length) const {
     return m_root->substr(start, length);
 }
 
+std::size_t Rope::copy_to(std::span<char> buffer, std::size_t start) const {
+    if (start >= length()) {
+        return 0;
+    }
+
+    std::size_t count = std::min(buffer.size(), length() - start);
+    char* out = buffer.data();
+
+    for_each_chunk(start, count, [&out](std::string_view chunk) {
+        out = std::copy(chunk.begin(), chunk.end(), out);
+    });
+
+    return count;
+}
+
+ChunkIterator Rope::chunks(std::size_t index) const {
+    return {m_root.get(), index};
+}
+
+ByteIterator Rope::bytes(std::size_t index) const {
+    return {m_root.get(), index};
+}
+
+ByteIterator Rope::begin() const { return bytes(0); }
+
+ByteIterator Rope::end() const { return bytes(length()); }
+
+std::uint64_t Rope::hash() const { return m_root->hash(); }
+
+bool Rope::shares_root(const Rope& other) const {
+    return m_root == other.m_root;
+}
+
+const Rope::Handle& Rope::root() const { return m_root; }
+
 bool Rope::is_balanced() const {
     if (m_root->depth() >= Rope::max_depth - 2) {
         return false;
@@ -45,6 +344,10 @@ Rope Rope::rebalance() const {
 }
 
 Rope Rope::insert(std::size_t index, const std::string& text) const {
+    if (auto root = insert_in_leaf(m_root, index, text)) {
+        return Rope{root};
+    }
+
     return insert(index, Rope{text});
 }
 
@@ -58,14 +361,13 @@ Rope Rope::insert(std::size_t index, const Rope& other) const {
     }
 
     auto [left, right] = m_root->split(index);
-    return Rope{std::make_shared<Branch>(left, other.m_root)}.append(
-        Rope{right});
+    return Rope{join(join(left, other.m_root), right)};
 }
 
 Rope Rope::append(const std::string& text) const { return append(Rope{text}); }
 
 Rope Rope::append(const Rope& other) const {
-    return Rope{std::make_shared<Branch>(m_root, other.m_root)};
+    return Rope{join(m_root, other.m_root)};
 }
 
 Rope Rope::prepend(const std::string& text) const {
@@ -73,13 +375,17 @@ Rope Rope::prepend(const std::string& text) const {
 }
 
 Rope Rope::prepend(const Rope& other) const {
-    return Rope{std::make_shared<Branch>(other.m_root, m_root)};
+    return Rope{join(other.m_root, m_root)};
 }
 
 Rope Rope::erase(std::size_t start, std::size_t length) const {
+    if (auto root = erase_in_leaf(m_root, start, length)) {
+        return Rope{root};
+    }
+
     auto lhs = m_root->split(start);
     auto rhs = lhs.second->split(length);
-    return Rope{std::make_shared<Branch>(lhs.first, rhs.second)};
+    return Rope{join(lhs.first, rhs.second)};
 }
 
 Node::Handle Rope::leaves_merge(const std::vector<Node::Handle>& leaves,
@@ -91,14 +397,43 @@ Node::Handle Rope::leaves_merge(const std::vector<Node::Handle>& leaves,
     }
 
     if (range == 2) {
-        return std::make_shared<Branch>(leaves[start], leaves[start + 1]);
+        return make<Branch>(leaves[start], leaves[start + 1]);
     }
 
     std::size_t mid = start + (range / 2);
-    return std::make_shared<Branch>(leaves_merge(leaves, start, mid),
+    return make<Branch>(leaves_merge(leaves, start, mid),
                                     leaves_merge(leaves, mid, end));
 }
 
+Node::Handle Rope::mapped_subtree(const Mapping::Handle& mapping,
+                                  std::size_t chunk_size, std::size_t first,
+                                  std::size_t last,
+                                  std::atomic<std::size_t>* progress,
+                                  std::stop_token stop) {
+    std::string_view text = mapping->view();
+    std::vector<Node::Handle> leaves;
+    leaves.reserve(last - first);
+
+    for (std::size_t i = first; i < last; ++i) {
+        // Indexing a leaf touches at most a chunk of the file, so checking
+        // once per leaf bounds how long a cancelled load goes on.
+        if (stop.stop_requested()) {
+            return nullptr;
+        }
+
+        leaves.push_back(make<MappedLeaf>(
+            mapping, text.substr(i * chunk_size, chunk_size)));
+        leaves.back()->hash();
+
+        if (progress != nullptr) {
+            progress->fetch_add(leaves.back()->length(),
+                                std::memory_order_relaxed);
+        }
+    }
+
+    return leaves_merge(leaves, 0, leaves.size());
+}
+
 Rope Rope::leaves_merge(const std::vector<Node::Handle>& leaves) {
     return Rope{leaves_merge(leaves, 0, leaves.size())};
 }
@@ -118,6 +453,15 @@ std::pair<Rope, Rope> Rope::split(std::size_t index) const {
     return {Rope{left}, Rope{right}};
 }
 
+Rope Rope::slice(std::size_t start, std::size_t length) const {
+    if (start == 0 && length >= this->length()) {
+        return *this;
+    }
+
+    auto tail = m_root->split(start).second;
+    return Rope{tail->split(std::min(length, tail->length())).first};
+}
+
 std::size_t Rope::find_line_start(std::size_t index) const {
     if (index == 0) {
         return 0;
@@ -129,6 +473,27 @@ std::size_t Rope::find_line_start(std::size_t index) const {
     return m_root->find_line_feed(index - 1) + 1;
 }
 
+std::size_t Rope::line_index(std::size_t index) const {
+    std::size_t lines = 0;
+    const Node* node = m_root.get();
+
+    while (node->depth() > 0) {
+        const auto& branch = static_cast<const Branch&>(*node);
+        std::size_t weight = branch.left()->length();
+
+        if (index < weight) {
+            node = branch.left().get();
+        } else {
+            lines += branch.left()->lfcnt();
+            index -= weight;
+            node = branch.right().get();
+        }
+    }
+
+    std::string_view chunk = node->chunk().substr(0, index);
+    return lines + std::count(chunk.begin(), chunk.end(), '\n');
+}
+
 std::size_t Rope::line_count() const {
     return m_root->lfcnt() + (m_root->operator[](length() - 1) != '\n');
 }
@@ -148,13 +513,12 @@ std::size_t Rope::index_from_pos(std::size_t line_index,
 }
 
 bool Rope::operator==(const Rope& other) const {
-    return m_root->to_string() == other.m_root->to_string();
+    return same_content(m_root, other.m_root);
 }
 
-bool Rope::operator!=(const Rope& other) const {
-    return m_root->to_string() != other.m_root->to_string();
-}
+bool Rope::operator!=(const Rope& other) const { return !(*this == other); }
 
 std::ostream& operator<<(std::ostream& os, const Rope& rope) {
-    return os << rope.to_string();
+    rope.for_each_chunk([&os](std::string_view chunk) { os << chunk; });
+    return os;
 }
\ No newline at end of file
@@ -1,10 +1,17 @@
 #pragma once
 
+#include "rope/iterator.hpp"
+#include "rope/mapping.hpp"
 #include "rope/node.hpp"
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <span>
+#include <stop_token>
 #include <string>
+#include <string_view>
 
 class Rope {
 private:
@@ -13,18 +20,54 @@ private:
 public:
     static constexpr std::size_t max_depth = 64;
 
-    using Handle = std::shared_ptr<Node>;
+    using Handle = Node::Handle;
 
     Rope();
     Rope(const std::string& text);
     Rope(const Rope& other) = default;
     Rope(Handle root);
 
+    static Rope from_chunks(std::string_view text, std::size_t chunk_size);
+    // Builds leaves viewing the mapping. Large files are split across one
+    // worker thread per core, each indexing and hashing its share of the
+    // chunks, so that comparing the rope later does not read the whole file
+    // on the thread doing it. When `progress` is given, the number of bytes
+    // indexed so far is added to it. Once `stop` is requested, the workers
+    // give up and an empty rope is returned.
+    static Rope from_mapping(const rope::Mapping::Handle& mapping,
+                             std::size_t chunk_size,
+                             std::atomic<std::size_t>* progress = nullptr,
+                             std::stop_token stop = {});
+    // Builds leaves viewing `text`, which lies within the mapping.
+    static Rope from_view(const rope::Mapping::Handle& mapping,
+                          std::string_view text, std::size_t chunk_size);
+
     std::string to_string() const;
     std::size_t length() const;
     char operator[](std::size_t index) const;
     std::string substr(std::size_t start, std::size_t length) const;
 
+    // Copies up to buffer.size() bytes starting at `start` straight out of
+    // the leaves and returns how many were written.
+    std::size_t copy_to(std::span<char> buffer, std::size_t start = 0) const;
+
+    // Calls `visit(std::string_view)` once per leaf slice, in order.
+    template<typename Visitor>
+    void for_each_chunk(Visitor&& visit) const;
+    template<typename Visitor>
+    void for_each_chunk(std::size_t start, std::size_t length,
+                        Visitor&& visit) const;
+
+    rope::ChunkIterator chunks(std::size_t index = 0) const;
+    rope::ByteIterator bytes(std::size_t index) const;
+    rope::ByteIterator begin() const;
+    rope::ByteIterator end() const;
+
+    std::uint64_t hash() const;
+    bool shares_root(const Rope& other) const;
+    // The tree itself, for looking at its shape.
+    const Handle& root() const;
+
     bool is_balanced() const;
     [[nodiscard]] Rope rebalance() const;
 
@@ -45,8 +88,13 @@ public:
                                const Rope& other) const;
 
     std::pair<Rope, Rope> split(std::size_t index) const;
+    // The rope of [start, start + length), sharing this rope's leaves.
+    Rope slice(std::size_t start, std::size_t length) const;
 
     std::size_t find_line_start(std::size_t index) const;
+    // Number of the line holding byte `index`, that is, of line feeds
+    // before it.
+    std::size_t line_index(std::size_t index) const;
     std::size_t line_count() const;
     std::size_t line_length(std::size_t line_index) const;
     std::size_t index_from_pos(std::size_t line_index,
@@ -58,9 +106,19 @@ public:
     friend std::ostream& operator<<(std::ostream& os, const Rope& rope);
 
 private:
+    // Fewer chunks than this per worker are not worth a thread.
+    static constexpr std::size_t min_leaves_per_worker = 4;
+
     Handle m_root{};
 
+    static Node::Handle mapped_subtree(const rope::Mapping::Handle& mapping,
+                                       std::size_t chunk_size,
+                                       std::size_t first, std::size_t last,
+                                       std::atomic<std::size_t>* progress,
+                                       std::stop_token stop);
     static Node::Handle leaves_merge(const std::vector<Node::Handle>& leaves,
                                      std::size_t start, std::size_t end);
     static Rope leaves_merge(const std::vector<Node::Handle>& leaves);
 };
+
+#include "rope/rope_inl.hpp"
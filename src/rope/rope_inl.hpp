@@ -0,0 +1,18 @@
+#pragma once
+
+#include "rope/rope.hpp"
+
+#include "rope/node.hpp"
+
+#include <cstddef>
+
+template<typename Visitor>
+void Rope::for_each_chunk(Visitor&& visit) const {
+    rope::for_each_chunk(*m_root, 0, m_root->length(), visit);
+}
+
+template<typename Visitor>
+void Rope::for_each_chunk(std::size_t start, std::size_t length,
+                          Visitor&& visit) const {
+    rope::for_each_chunk(*m_root, start, length, visit);
+}
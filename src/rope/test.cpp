@@ -1,16 +1,432 @@
+#include "rope/btree.hpp"
+#include "rope/btree_rope.hpp"
+#include "rope/node.hpp"
+#include "rope/pool.hpp"
 #include "rope/rope.hpp"
+#include "test.hpp"
 
-#include <iostream>
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
 
-int main() {
-    Rope rope("asdfasdf\n");
-    std::cout << rope << std::endl;
-    std::cout << rope.line_count() << std::endl;
-    std::cout << rope.find_line_start(1) << std::endl;
+// Checks ropes, and the B-tree engine measured against them, against plain
+// strings edited the same way, and the shape of their trees along the way.
+
+namespace {
+
+// Expects the AVL invariant below `node`, and returns its depth.
+std::size_t check_balance(const rope::Node& node) {
+    if (node.depth() == 0) {
+        return 0;
+    }
+
+    const auto& branch = static_cast<const rope::Branch&>(node);
+    std::size_t left = check_balance(*branch.left());
+    std::size_t right = check_balance(*branch.right());
+
+    test::expect(left <= right + 1 && right <= left + 1);
+    test::expect(node.depth() == std::max(left, right) + 1);
+    test::expect(node.length()
+                 == branch.left()->length() + branch.right()->length());
+    return node.depth();
+}
+
+// Expects no heap leaf of `rope` to be longer than Leaf::max_length.
+void check_leaves(const Rope& rope) {
+    for (const auto& leaf : rope.root()->leaves()) {
+        if (dynamic_cast<const rope::Leaf*>(leaf.get()) != nullptr) {
+            test::expect(leaf->length() <= rope::Leaf::max_length);
+        }
+    }
+}
+
+void check_lines(const Rope& rope, const std::string& text) {
+    auto lines = static_cast<std::size_t>(
+        std::count(text.begin(), text.end(), '\n'));
+    lines += !text.empty() && text.back() != '\n';
+    test::expect_equal(rope.line_count(), lines);
+
+    std::size_t line = 0;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        if (i == 0 || text[i - 1] == '\n') {
+            test::expect_equal(rope.find_line_start(line), i);
+            ++line;
+        }
+        if (i % 97 == 0) {
+            auto before = static_cast<std::size_t>(
+                std::count(text.begin(), text.begin() + i, '\n'));
+            test::expect_equal(rope.line_index(i), before);
+        }
+    }
+}
+
+// Expects the B-tree invariants below `node`: every child one level below
+// its parent, the counts of each child kept right, and nodes within their
+// bounds unless they are the root.
+void check_btree(const rope::btree::Node& node, bool root) {
+    namespace btree = rope::btree;
+
+    if (node.is_leaf()) {
+        std::string_view text = static_cast<const btree::Leaf&>(node).text();
+        test::expect(text.size() == node.length());
+        test::expect(static_cast<std::size_t>(
+                         std::count(text.begin(), text.end(), '\n'))
+                     == node.lfcnt());
+        test::expect(node.length() <= btree::max_leaf_length);
+        test::expect(root || !node.underfull());
+        return;
+    }
+
+    const auto& internal = static_cast<const btree::Internal&>(node);
+    test::expect(internal.count() <= btree::max_children);
+    test::expect(root ? internal.count() >= 2 : !node.underfull());
+
+    std::size_t length = 0;
+    std::size_t lfcnt = 0;
+    for (std::size_t i = 0; i < internal.count(); ++i) {
+        const btree::Node& child = *internal.children()[i];
+        test::expect(child.height() + 1 == node.height());
+        test::expect(internal.lengths()[i] == child.length());
+        test::expect(internal.lfcnts()[i] == child.lfcnt());
+        length += child.length();
+        lfcnt += child.lfcnt();
+        check_btree(child, false);
+    }
+    test::expect(length == node.length());
+    test::expect(lfcnt == node.lfcnt());
+}
+
+std::string random_text(std::mt19937_64& random, std::size_t length) {
+    std::uniform_int_distribution<int> byte{0, 39};
+    std::string text;
+
+    for (std::size_t i = 0; i < length; ++i) {
+        int b = byte(random);
+        text.push_back(b == 0 ? '\n' : static_cast<char>('a' + b % 26));
+    }
+
+    return text;
+}
+
+void test_small_rope() {
+    Rope rope{std::string{"asdfasdf\n"}};
+    test::expect_equal(rope, std::string{"asdfasdf\n"});
+    test::expect_equal(rope.line_count(), std::size_t{1});
+    test::expect_equal(rope.find_line_start(1), std::size_t{9});
 
     rope = rope.insert(3, "j");
+    test::expect_equal(rope, std::string{"asdjfasdf\n"});
+    test::expect_equal(rope.line_count(), std::size_t{1});
+    test::expect_equal(rope.find_line_start(1), std::size_t{10});
+}
+
+// Random inserts, erases and replacements keep the text, the line index and
+// the AVL invariant right.
+void test_random_edits() {
+    std::mt19937_64 random{3};
+    std::string text = random_text(random, 20000);
+    Rope rope{text};
+
+    for (std::size_t step = 0; step < 2000; ++step) {
+        std::uniform_int_distribution<std::size_t> position{0, text.size()};
+        std::size_t at = position(random);
+        std::uniform_int_distribution<std::size_t> span{
+            0, std::min<std::size_t>(text.size() - at, 6000)};
+        std::uniform_int_distribution<int> kind{0, 9};
+        std::string inserted;
+
+        switch (kind(random)) {
+        case 0:
+        case 1:
+        case 2:
+        case 3:
+            inserted = random_text(random, step % 50 == 0 ? 9000 : 3);
+            rope = rope.insert(at, inserted);
+            text.insert(at, inserted);
+            break;
+        case 4:
+        case 5:
+        case 6: {
+            std::size_t length = span(random) / (step % 10 == 0 ? 1 : 100);
+            rope = rope.erase(at, length);
+            text.erase(at, length);
+            break;
+        }
+        default: {
+            std::size_t length = span(random) / 10;
+            inserted = random_text(random, 20);
+            rope = rope.replace(at, length, inserted);
+            text.replace(at, length, inserted);
+            break;
+        }
+        }
+
+        check_balance(*rope.root());
+        test::expect(rope.root()->depth() < Rope::max_depth);
+
+        if (step % 100 == 0) {
+            test::expect(rope.to_string() == text);
+            check_leaves(rope);
+        }
+    }
+
+    test::expect(rope.to_string() == text);
+    check_lines(rope, text);
+}
+
+// Appending one piece at a time, the worst case for a tree without
+// rebalancing, keeps the depth logarithmic.
+void test_appends_stay_shallow() {
+    Rope rope;
+    std::string text;
+
+    for (std::size_t i = 0; i < 4000; ++i) {
+        std::string piece(rope::Leaf::max_length / 2 + i % 7, 'a' + i % 26);
+        rope = rope.append(piece);
+        text += piece;
+    }
+
+    check_balance(*rope.root());
+    // An AVL tree of n leaves is at most 1.44 log2(n) deep.
+    test::expect(rope.root()->depth() <= 18);
+    test::expect(rope.to_string() == text);
+}
+
+// Typing goes into the leaf under the cursor instead of adding a leaf per
+// keystroke, and only copies the path down to it.
+void test_typing_rewrites_leaves() {
+    Rope rope;
+    std::string text;
+
+    for (std::size_t i = 0; i < 3000; ++i) {
+        std::size_t at = i / 2;
+        rope = rope.insert(at, std::string(1, 'a' + i % 26));
+        text.insert(at, 1, 'a' + i % 26);
+    }
+
+    test::expect_equal(rope.root()->leaves().size(), std::size_t{1});
+    test::expect(rope.to_string() == text);
+
+    // Leaves of a new rope are full, so the first keystroke in one splits
+    // it, and the ones after go into the halves.
+    std::mt19937_64 random{4};
+    rope = Rope{random_text(random, 1 << 20)};
+
+    for (std::size_t at = 0; at < rope.length(); at += 99991) {
+        rope = rope.insert(at, "x");
+
+        for (std::size_t i = 1; i < 100; ++i) {
+            std::size_t depth = rope.root()->depth();
+            std::size_t allocations = rope::pool::allocations();
+            rope = rope.insert(at + i, "x");
+            allocations = rope::pool::allocations() - allocations;
+
+            test::expect(allocations <= depth + 1);
+        }
+    }
+
+    check_leaves(rope);
+}
+
+// Long text is cut into leaves within the bounds.
+void test_long_text_is_cut() {
+    std::mt19937_64 random{5};
+
+    for (std::size_t length : {rope::Leaf::max_length + 1, std::size_t{100000},
+                               std::size_t{1} << 20}) {
+        std::string text = random_text(random, length);
+        Rope rope{text};
+
+        for (const auto& leaf : rope.root()->leaves()) {
+            test::expect(leaf->length() >= rope::Leaf::min_length);
+            test::expect(leaf->length() <= rope::Leaf::max_length);
+        }
+        check_balance(*rope.root());
+        test::expect(rope.to_string() == text);
+    }
+}
+
+void test_iterators() {
+    std::mt19937_64 random{6};
+    std::string text = random_text(random, 50000);
+    Rope rope{text};
+
+    // Edits leave leaves of all sizes behind.
+    for (std::size_t i = 0; i < 200; ++i) {
+        std::size_t at = (i * 7919) % text.size();
+        std::string inserted = random_text(random, i % 13);
+        rope = rope.replace(at, i % 5, inserted);
+        text.replace(at, i % 5, inserted);
+    }
+
+    // Chunks walk the leaves in order both ways, with their offsets.
+    std::string forward;
+    std::size_t count = 0;
+    for (auto chunks = rope.chunks(); !chunks.at_end(); ++chunks, ++count) {
+        test::expect_equal(chunks.offset(), forward.size());
+        forward += *chunks;
+    }
+    test::expect(forward == text);
+    test::expect_equal(count, rope.root()->leaves().size());
+
+    auto chunks = rope.chunks(text.size() - 1);
+    std::string backward;
+    for (; !chunks.at_end(); --chunks) {
+        test::expect_equal(std::string_view{text}.substr(chunks.offset(),
+                                                         (*chunks).size()),
+                           *chunks);
+        backward.insert(0, *chunks);
+    }
+    test::expect(backward == text);
+
+    // Bytes start anywhere and step both ways.
+    test::expect(std::string(rope.begin(), rope.end()) == text);
+    test::expect_equal(*rope.end(), '\0');
+    test::expect_equal(static_cast<std::size_t>(
+                           std::distance(rope.begin(), rope.end())),
+                       text.size());
+
+    for (std::size_t start = 0; start < text.size(); start += 4099) {
+        auto it = rope.bytes(start);
+        test::expect_equal(it.index(), start);
+
+        for (std::size_t i = start; i < std::min(text.size(), start + 5000);
+             ++i, ++it) {
+            test::expect_equal(*it, text[i]);
+        }
+        for (std::size_t i = it.index(); i > start; --i) {
+            --it;
+            test::expect_equal(*it, text[i - 1]);
+        }
+        test::expect(it == rope.bytes(start));
+    }
+}
+
+// Compares everything BTreeRope reads against the string it should hold.
+void check_btree_text(const BTreeRope& rope, const std::string& text,
+                      std::mt19937_64& random) {
+    test::expect(rope.to_string() == text);
+    test::expect_equal(rope.length(), text.size());
+
+    auto lines = static_cast<std::size_t>(
+        std::count(text.begin(), text.end(), '\n'));
+    lines += text.empty() || text.back() != '\n';
+    test::expect_equal(rope.line_count(), lines);
+
+    std::size_t line = 0;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        if (i == 0 || text[i - 1] == '\n') {
+            test::expect_equal(rope.find_line_start(line), i);
+            ++line;
+        }
+    }
+    test::expect_equal(rope.find_line_start(lines), text.size());
+
+    // Positions within lines, chunks of any range, and single bytes.
+    for (std::size_t i = 0; i < 20 && !text.empty(); ++i) {
+        std::size_t at = random() % text.size();
+        // Not finding a line feed gives npos, which wraps around to 0.
+        std::size_t start = at == 0 ? 0 : text.rfind('\n', at - 1) + 1;
+        auto index = static_cast<std::size_t>(
+            std::count(text.begin(), text.begin() + at, '\n'));
+        test::expect_equal(rope.index_from_pos(index, at - start), at);
+        test::expect_equal(rope[at], text[at]);
+
+        std::size_t length = random() % 10000;
+        std::string chunks;
+        rope.for_each_chunk(at, length, [&chunks](std::string_view chunk) {
+            chunks += chunk;
+        });
+        test::expect(chunks == text.substr(at, length));
+        test::expect(rope.substr(at, length) == text.substr(at, length));
+    }
+}
+
+// Random edits large enough to split and merge nodes on every level, with
+// the tree checked after each one.
+void test_btree_random_edits() {
+    std::mt19937_64 random{9};
+    std::string text = random_text(random, 30000);
+    BTreeRope rope{text};
+    std::size_t max_height = 0;
+
+    for (std::size_t step = 0; step < 3000; ++step) {
+        std::size_t at = random() % (text.size() + 1);
+        std::size_t span = random() % (text.size() - at + 1);
+
+        switch (random() % 8) {
+        case 0:
+        case 1: {
+            // Now and then large enough to add a level.
+            std::string inserted = random_text(
+                random, step % 40 == 0 ? 300000 : random() % 20);
+            rope = rope.insert(at, inserted);
+            text.insert(at, inserted);
+            break;
+        }
+        case 2:
+        case 3: {
+            std::size_t length = step % 40 == 1 ? span : span % 50;
+            rope = rope.erase(at, length);
+            text.erase(at, length);
+            break;
+        }
+        case 4: {
+            std::string inserted = random_text(random, random() % 5000);
+            std::size_t length = span % 5000;
+            rope = rope.replace(at, length, inserted);
+            text.replace(at, length, inserted);
+            break;
+        }
+        case 5: {
+            BTreeRope slice = rope.slice(at, span);
+            test::expect(slice.to_string() == text.substr(at, span));
+            check_btree(*slice.root(), true);
+            break;
+        }
+        case 6:
+            if (text.size() > 1500000) {
+                rope = rope.slice(at / 2, text.size() / 4);
+                text = text.substr(at / 2, text.size() / 4);
+            }
+            break;
+        default:
+            rope = rope.append("\n").prepend("x");
+            text = "x" + text + "\n";
+            break;
+        }
+
+        check_btree(*rope.root(), true);
+        max_height = std::max(max_height, rope.height());
+        if (step % 50 == 0) {
+            check_btree_text(rope, text, random);
+        }
+    }
+
+    check_btree_text(rope, text, random);
+    test::expect(max_height >= 3);
+
+    // Down to nothing and back.
+    rope = rope.erase(0, text.size());
+    check_btree(*rope.root(), true);
+    check_btree_text(rope, "", random);
+    rope = rope.insert(0, "a\nb");
+    check_btree_text(rope, "a\nb", random);
+}
+
+} // namespace
+
+int main() {
+    test::run("small rope", test_small_rope);
+    test::run("random edits", test_random_edits);
+    test::run("appends stay shallow", test_appends_stay_shallow);
+    test::run("typing rewrites leaves", test_typing_rewrites_leaves);
+    test::run("long text is cut", test_long_text_is_cut);
+    test::run("iterators", test_iterators);
+    test::run("btree random edits", test_btree_random_edits);
 
-    std::cout << rope << std::endl;
-    std::cout << rope.line_count() << std::endl;
-    std::cout << rope.find_line_start(1) << std::endl;
-}
\ No newline at end of file
+    return test::result();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <source_location>
+#include <string_view>
+
+// A minimal harness for the test programs. Each test is a named function
+// making checks; failed checks are reported with where they were made, and
+// the program exits with a failure status if any failed, which is what
+// ctest goes by.
+namespace test {
+
+inline std::size_t& failures() {
+    static std::size_t count = 0;
+    return count;
+}
+
+inline void expect(bool condition, std::source_location where
+                                   = std::source_location::current()) {
+    if (!condition) {
+        ++failures();
+        std::cerr << where.file_name() << ":" << where.line()
+                  << ": check failed\n";
+    }
+}
+
+// Like expect(actual == expected), printing both sides if they differ.
+template<typename Actual, typename Expected>
+void expect_equal(const Actual& actual, const Expected& expected,
+                  std::source_location where
+                  = std::source_location::current()) {
+    if (!(actual == expected)) {
+        ++failures();
+        std::cerr << where.file_name() << ":" << where.line()
+                  << ": expected `" << expected << "`, got `" << actual
+                  << "`\n";
+    }
+}
+
+template<typename Body>
+void run(std::string_view name, Body&& body) {
+    std::size_t before = failures();
+    body();
+    std::cout << (failures() == before ? "ok   " : "FAIL ") << name << "\n";
+}
+
+inline int result() { return failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE; }
+
+} // namespace test
@@ -0,0 +1,797 @@
+#include "undo/history.hpp"
+
+#include "rope/mapping.hpp"
+#include "rope/node.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// A sidecar holds a header, one record per state, and then the edits of
+// each state in turn, every one followed by the text it removed and the
+// text it inserted. Everything is in host byte order.
+constexpr char magic[8] = {'J', 'E', 'U', 'N', 'D', 'O', '0', '1'};
+
+struct Header {
+    char magic[8];
+    std::uint64_t size;
+    std::int64_t mtime;
+    std::uint64_t count;
+    std::uint64_t current;
+};
+
+struct Record {
+    std::uint64_t parent;
+    std::uint64_t redo;
+    std::uint64_t edits;
+    std::uint64_t edit_count;
+    std::uint64_t bytes;
+    std::int64_t time;
+    std::int32_t before_line;
+    std::int32_t before_column;
+    std::int32_t after_line;
+    std::int32_t after_column;
+    std::uint64_t live;
+};
+
+struct EditRecord {
+    std::uint64_t position;
+    std::uint64_t removed;
+    std::uint64_t inserted;
+};
+
+// Stored text is viewed in leaves of this size.
+constexpr std::size_t chunk_size = 1024 * 1024;
+
+// Thrown on reading stored states that do not add up. It never leaves
+// History, which drops the stored history instead.
+class Corrupt : public std::runtime_error {
+public:
+    Corrupt() : std::runtime_error{"Corrupt undo history"} {}
+};
+
+template<typename T>
+T read(std::string_view data, std::size_t offset) {
+    T value;
+    std::memcpy(&value, data.data() + offset, sizeof(T));
+    return value;
+}
+
+// Throws Corrupt unless `length` bytes at `position` lie within `text`.
+void check_range(const Rope& text, std::size_t position, std::size_t length) {
+    if (position > text.length() || length > text.length() - position) {
+        throw Corrupt{};
+    }
+}
+
+// Throws Corrupt unless `cursor` lies within `text`, at most at the end
+// of a line.
+void check_cursor(const Rope& text, Cursor cursor) {
+    if (cursor.line < 0 || cursor.column < 0) {
+        throw Corrupt{};
+    }
+
+    auto line = static_cast<std::size_t>(cursor.line);
+    auto column = static_cast<std::size_t>(cursor.column);
+    if (text.length() == 0 ? line > 0 || column > 0
+                           : line >= text.line_count()
+                                 || column > text.line_length(line)) {
+        throw Corrupt{};
+    }
+}
+
+// Buffers writes to a file descriptor.
+class Writer {
+public:
+    explicit Writer(int fd) : m_fd{fd} {}
+
+    void bytes(std::string_view bytes) {
+        if (m_buffer.size() + bytes.size() > capacity) {
+            flush();
+        }
+        if (bytes.size() > capacity) {
+            write_all(bytes);
+            return;
+        }
+        m_buffer += bytes;
+    }
+
+    template<typename T>
+    void value(const T& value) {
+        bytes({reinterpret_cast<const char*>(&value), sizeof(T)});
+    }
+
+    void text(const Rope& text) {
+        text.for_each_chunk([this](std::string_view chunk) { bytes(chunk); });
+    }
+
+    void flush() {
+        write_all(m_buffer);
+        m_buffer.clear();
+    }
+
+private:
+    static constexpr std::size_t capacity = 1024 * 1024;
+
+    int m_fd{};
+    std::string m_buffer{};
+
+    void write_all(std::string_view bytes) {
+        while (!bytes.empty()) {
+            ssize_t written = write(m_fd, bytes.data(), bytes.size());
+            if (written == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error{"Could not write undo history"};
+            }
+            bytes.remove_prefix(written);
+        }
+    }
+};
+
+} // namespace
+
+History::History(std::size_t budget) : m_budget{budget} {}
+
+void History::begin_step(Cursor cursor) {
+    m_open = false;
+    m_step_cursor = cursor;
+}
+
+void History::record(Edit edit, Cursor cursor, const Rope& rope) {
+    // The edit may join the current state, so its stored edits are read
+    // before anything is changed.
+    try {
+        unpack();
+        if (!m_nodes.empty()) {
+            edits_of(m_current);
+        }
+    } catch (const Corrupt&) {
+        forget();
+    }
+
+    if (m_nodes.empty()) {
+        m_current = add(none, cursor);
+    }
+
+    if (!m_open) {
+        m_current = add(m_current, m_step_cursor.value_or(cursor));
+        m_step_cursor.reset();
+        m_open = true;
+    }
+
+    Node& node = m_nodes[m_current];
+    auto& edits = edits_of(m_current);
+    m_text = rope;
+
+    // Removed text is a slice of the text before the edit, and a few bytes
+    // of it would keep the whole leaves they were in alive.
+    if (edit.removed.length() < rope::Leaf::max_length) {
+        edit.removed = Rope{edit.removed.to_string()};
+    }
+
+    if (!edits.empty()) {
+        Edit& last = edits.back();
+        std::size_t old_size = size(last);
+
+        if (merge(last, edit)) {
+            node.bytes = node.bytes - old_size + size(last);
+            m_bytes = m_bytes - old_size + size(last);
+            trim();
+            return;
+        }
+    }
+
+    std::size_t added = size(edit);
+    edits.push_back(std::move(edit));
+    node.bytes += added;
+    m_bytes += added;
+    trim();
+}
+
+std::optional<Cursor> History::undo(Rope& rope, Cursor cursor) {
+    unpack();
+
+    if (m_nodes.empty() || m_nodes[m_current].parent == none) {
+        m_open = false;
+        return {};
+    }
+
+    Node& node = m_nodes[m_current];
+    Cursor before = node.before;
+    node.after = cursor;
+    m_nodes[node.parent].redo = m_current;
+
+    if (!move_to(node.parent, rope, before)) {
+        return {};
+    }
+
+    return before;
+}
+
+std::optional<Cursor> History::redo(Rope& rope) {
+    unpack();
+
+    if (m_nodes.empty() || m_nodes[m_current].redo == none) {
+        m_open = false;
+        return {};
+    }
+
+    std::size_t child = m_nodes[m_current].redo;
+    if (!move_to(child, rope, m_nodes[child].after)) {
+        return {};
+    }
+
+    return m_nodes[child].after;
+}
+
+bool History::jump(Rope& rope, std::size_t state) {
+    unpack();
+
+    if (m_nodes.empty()) {
+        return false;
+    }
+
+    std::size_t target
+        = nearest(std::min(state, m_nodes.size() - 1), state > m_current);
+    if (target == m_current) {
+        return false;
+    }
+
+    return move_to(target, rope);
+}
+
+bool History::jump(Rope& rope, Clock::time_point time) {
+    unpack();
+
+    if (m_nodes.empty()) {
+        return false;
+    }
+
+    // States are numbered in creation order, so their times are sorted.
+    auto after = std::partition_point(
+        m_nodes.begin(), m_nodes.end(),
+        [time](const Node& node) { return node.time <= time; });
+    auto state = static_cast<std::size_t>(after - m_nodes.begin());
+
+    std::size_t target
+        = state == 0 ? nearest(0, true) : nearest(state - 1, false);
+    if (target == m_current) {
+        return false;
+    }
+
+    return move_to(target, rope);
+}
+
+std::vector<History::Edit> History::path(std::size_t from, std::size_t to) {
+    unpack();
+
+    // States are gone if the history was dropped on the way to `to`.
+    if (from >= m_nodes.size() || to >= m_nodes.size()) {
+        return {};
+    }
+
+    try {
+        return path_edits(from, to);
+    } catch (const Corrupt&) {
+        forget();
+        return {};
+    }
+}
+
+std::vector<History::Edit> History::path_edits(std::size_t from,
+                                               std::size_t to) {
+    std::vector<bool> above_to(m_nodes.size());
+    for (std::size_t state = to; state != none;
+         state = m_nodes[state].parent) {
+        above_to[state] = true;
+    }
+
+    std::vector<Edit> edits;
+    std::size_t top = from;
+
+    for (; !above_to[top]; top = m_nodes[top].parent) {
+        // Only a damaged history has states outside the current tree.
+        if (m_nodes[top].parent == none) {
+            throw Corrupt{};
+        }
+
+        const auto& undone = edits_of(top);
+        for (auto it = undone.rbegin(); it != undone.rend(); ++it) {
+            edits.push_back({it->position, it->inserted, it->removed});
+        }
+    }
+
+    std::vector<std::size_t> down;
+    for (std::size_t state = to; state != top;
+         state = m_nodes[state].parent) {
+        down.push_back(state);
+    }
+
+    for (auto it = down.rbegin(); it != down.rend(); ++it) {
+        const auto& redone = edits_of(*it);
+        edits.insert(edits.end(), redone.begin(), redone.end());
+    }
+
+    return edits;
+}
+
+std::size_t History::state() const { return m_current; }
+
+History::Clock::time_point History::time() {
+    unpack();
+    return m_nodes.empty() ? Clock::now() : m_nodes[m_current].time;
+}
+
+std::optional<Rope> History::peek_undo() {
+    unpack();
+
+    if (m_nodes.empty() || m_nodes[m_current].parent == none) {
+        return {};
+    }
+
+    try {
+        return text_of(m_nodes[m_current].parent);
+    } catch (const Corrupt&) {
+        forget();
+        return {};
+    }
+}
+
+std::size_t History::bytes() {
+    unpack();
+    return m_bytes;
+}
+
+void History::set_budget(std::size_t budget) {
+    unpack();
+    m_budget = budget;
+    trim();
+}
+
+std::string History::sidecar(const std::string& filename) {
+    return filename + ".jaledit-undo";
+}
+
+std::optional<History::Stamp> History::stamp(const std::string& filename) {
+    struct stat sb;
+
+    if (stat(filename.c_str(), &sb) == -1) {
+        return {};
+    }
+
+    return Stamp{static_cast<std::uint64_t>(sb.st_size),
+                 sb.st_mtim.tv_sec * 1'000'000'000 + sb.st_mtim.tv_nsec};
+}
+
+void History::store(const std::string& filename, Stamp stamp,
+                    std::size_t saved) {
+    unpack();
+
+    std::string path = sidecar(filename);
+
+    // Every stored edit is read before anything is written, which is also
+    // when a damaged sidecar would turn up.
+    try {
+        for (std::size_t state = 0; state < m_nodes.size(); ++state) {
+            edits_of(state);
+        }
+    } catch (const Corrupt&) {
+        forget();
+    }
+
+    if (saved >= m_nodes.size() || !m_nodes[saved].live) {
+        unlink(path.c_str());
+        return;
+    }
+
+    // Lay out the edits first so that the records can point at them.
+    std::vector<Record> records(m_nodes.size());
+    std::size_t offset = sizeof(Header) + records.size() * sizeof(Record);
+
+    for (std::size_t state = 0; state < m_nodes.size(); ++state) {
+        const Node& node = m_nodes[state];
+        const auto& edits = edits_of(state);
+
+        records[state] = {
+            .parent = node.parent,
+            .redo = node.redo,
+            .edits = offset,
+            .edit_count = edits.size(),
+            .bytes = node.bytes,
+            .time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        node.time.time_since_epoch())
+                        .count(),
+            .before_line = node.before.line,
+            .before_column = node.before.column,
+            .after_line = node.after.line,
+            .after_column = node.after.column,
+            .live = node.live,
+        };
+
+        for (const auto& edit : edits) {
+            offset += sizeof(EditRecord) + size(edit);
+        }
+    }
+
+    Header header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.size = stamp.size;
+    header.mtime = stamp.mtime;
+    header.count = m_nodes.size();
+    header.current = saved;
+
+    // Written beside the old sidecar and moved over it, since restored
+    // edits may still view the old one.
+    std::string tmp_path = path + "-tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1) {
+        throw std::runtime_error{"Could not open undo history"};
+    }
+
+    try {
+        Writer writer{fd};
+        writer.value(header);
+        for (const auto& record : records) {
+            writer.value(record);
+        }
+
+        for (std::size_t state = 0; state < m_nodes.size(); ++state) {
+            for (const auto& edit : edits_of(state)) {
+                writer.value(EditRecord{
+                    .position = edit.position,
+                    .removed = edit.removed.length(),
+                    .inserted = edit.inserted.length(),
+                });
+                writer.text(edit.removed);
+                writer.text(edit.inserted);
+            }
+        }
+
+        writer.flush();
+    } catch (...) {
+        close(fd);
+        unlink(tmp_path.c_str());
+        throw;
+    }
+
+    // Synced before the rename, so that a crash cannot leave the sidecar
+    // replaced by a file whose content never reached the disk.
+    if (fsync(fd) == -1) {
+        close(fd);
+        unlink(tmp_path.c_str());
+        throw std::runtime_error{"Could not sync undo history"};
+    }
+
+    close(fd);
+
+    if (std::rename(tmp_path.c_str(), path.c_str()) == -1) {
+        unlink(tmp_path.c_str());
+        throw std::runtime_error{"Could not replace undo history"};
+    }
+}
+
+bool History::restore(const std::string& filename, Stamp stamp,
+                      const Rope& text) {
+    rope::Mapping::Handle stored;
+
+    try {
+        stored = std::make_shared<const rope::Mapping>(sidecar(filename));
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+
+    std::string_view data = stored->view();
+    if (data.size() < sizeof(Header)) {
+        return false;
+    }
+
+    auto header = read<Header>(data, 0);
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0
+        || Stamp{header.size, header.mtime} != stamp
+        || header.current >= header.count
+        || (data.size() - sizeof(Header)) / sizeof(Record) < header.count) {
+        return false;
+    }
+
+    *this = History{m_budget};
+    m_stored = std::move(stored);
+    m_unread = text;
+    m_current = header.current;
+
+    return true;
+}
+
+bool History::dropped() const { return m_dropped; }
+
+// Folds `edit` into `last` when it continues it: typing right after the
+// inserted text, backspacing from its end, or deleting forward from it.
+bool History::merge(Edit& last, const Edit& edit) {
+    std::size_t last_end = last.position + last.inserted.length();
+
+    if (edit.removed.length() == 0) {
+        if (edit.position != last_end) {
+            return false;
+        }
+
+        last.inserted = last.inserted.append(edit.inserted);
+        return true;
+    }
+
+    if (edit.inserted.length() != 0) {
+        return false;
+    }
+
+    if (edit.position == last_end) {
+        last.removed = last.removed.append(edit.removed);
+        return true;
+    }
+
+    if (edit.position + edit.removed.length() != last_end) {
+        return false;
+    }
+
+    if (edit.position >= last.position) {
+        last.inserted
+            = last.inserted.slice(0, edit.position - last.position);
+    } else {
+        std::size_t before = last.position - edit.position;
+        last.removed = edit.removed.slice(0, before).append(last.removed);
+        last.inserted = Rope{};
+        last.position = edit.position;
+    }
+
+    return true;
+}
+
+std::size_t History::size(const Edit& edit) {
+    return edit.removed.length() + edit.inserted.length();
+}
+
+std::size_t History::add(std::size_t parent, Cursor before) {
+    std::size_t state = m_nodes.size();
+    m_nodes.push_back({.parent = parent,
+                       .before = before,
+                       .after = before,
+                       .time = Clock::now()});
+
+    if (parent != none) {
+        m_nodes[parent].children.push_back(state);
+        m_nodes[parent].redo = state;
+    }
+
+    return state;
+}
+
+bool History::move_to(std::size_t state, Rope& rope,
+                      std::optional<Cursor> cursor) {
+    // A cursor read from the sidecar is checked along with the edits, as
+    // the buffer puts it in place as it is.
+    try {
+        Rope text = text_of(state);
+        if (cursor) {
+            check_cursor(text, *cursor);
+        }
+        m_text = std::move(text);
+    } catch (const Corrupt&) {
+        forget();
+        return false;
+    }
+
+    rope = m_text;
+    m_current = state;
+    m_open = false;
+    m_step_cursor.reset();
+    return true;
+}
+
+void History::forget() {
+    std::optional<Cursor> step_cursor = m_step_cursor;
+    *this = History{m_budget};
+    m_step_cursor = step_cursor;
+    m_dropped = true;
+}
+
+// Reads the states of a restored history, leaving their edits and text
+// in the sidecar.
+void History::unpack() {
+    if (!m_unread) {
+        return;
+    }
+
+    // A damaged sidecar is dropped, leaving an empty history.
+    std::string_view data = m_stored->view();
+    auto header = read<Header>(data, 0);
+    std::vector<Node> nodes(header.count);
+    std::size_t bytes = 0;
+
+    for (std::size_t state = 0; state < nodes.size(); ++state) {
+        auto record
+            = read<Record>(data, sizeof(Header) + state * sizeof(Record));
+
+        // Parents are always created before their children.
+        if ((record.parent != none && record.parent >= state)
+            || (record.redo != none && record.redo >= nodes.size())
+            || record.edits > data.size()) {
+            forget();
+            return;
+        }
+
+        Node& node = nodes[state];
+        node.parent = record.parent;
+        node.redo = record.redo;
+        node.stored = record.edits;
+        node.stored_edits = record.edit_count;
+        node.bytes = record.bytes;
+        node.before = {record.before_line, record.before_column};
+        node.after = {record.after_line, record.after_column};
+        node.time = Clock::time_point{
+            std::chrono::duration_cast<Clock::duration>(
+                std::chrono::nanoseconds{record.time})};
+        node.live = record.live != 0;
+
+        if (node.parent != none) {
+            nodes[node.parent].children.push_back(state);
+        }
+        if (node.live) {
+            bytes += node.bytes;
+        }
+    }
+
+    if (!nodes[m_current].live) {
+        forget();
+        return;
+    }
+
+    m_nodes = std::move(nodes);
+    m_text = std::move(*m_unread);
+    m_unread.reset();
+    m_bytes = bytes;
+
+    while (!m_nodes[m_oldest].live) {
+        ++m_oldest;
+    }
+}
+
+std::vector<History::Edit>& History::edits_of(std::size_t state) {
+    Node& node = m_nodes[state];
+    if (node.stored == none) {
+        return node.edits;
+    }
+
+    std::string_view data = m_stored->view();
+    std::size_t offset = node.stored;
+
+    for (std::size_t i = 0; i < node.stored_edits; ++i) {
+        if (data.size() - offset < sizeof(EditRecord)) {
+            throw Corrupt{};
+        }
+
+        auto record = read<EditRecord>(data, offset);
+        offset += sizeof(EditRecord);
+
+        if (data.size() - offset < record.removed
+            || data.size() - offset - record.removed < record.inserted) {
+            throw Corrupt{};
+        }
+
+        Rope removed = Rope::from_view(
+            m_stored, data.substr(offset, record.removed), chunk_size);
+        offset += record.removed;
+        Rope inserted = Rope::from_view(
+            m_stored, data.substr(offset, record.inserted), chunk_size);
+        offset += record.inserted;
+
+        node.edits.push_back({record.position, removed, inserted});
+    }
+
+    node.stored = none;
+    return node.edits;
+}
+
+// Rebuilds the text of a state from the current one, undoing edits up to
+// their common ancestor and redoing them down from there.
+Rope History::text_of(std::size_t state) {
+    Rope text = m_text;
+
+    for (const auto& edit : path_edits(m_current, state)) {
+        check_range(text, edit.position, edit.removed.length());
+        text = text.replace(edit.position, edit.removed.length(),
+                            edit.inserted);
+    }
+
+    return text;
+}
+
+// The first state kept at or past `state` going the given way, or failing
+// that, going the other way. The current state is always kept.
+std::size_t History::nearest(std::size_t state, bool forward) const {
+    for (std::size_t i = state; i < m_nodes.size(); forward ? ++i : --i) {
+        if (m_nodes[i].live) {
+            return i;
+        }
+    }
+
+    for (std::size_t i = state; i < m_nodes.size(); forward ? --i : ++i) {
+        if (m_nodes[i].live) {
+            return i;
+        }
+    }
+
+    return m_current;
+}
+
+// A state can go if nothing leads through it: a dead-end branch, or the
+// root when it has a single child. The current state and its parent stay,
+// so the latest step can always be undone.
+bool History::droppable(std::size_t state) const {
+    const Node& node = m_nodes[state];
+
+    if (!node.live || state == m_current) {
+        return false;
+    }
+    if (node.parent != none) {
+        return node.children.empty();
+    }
+
+    return node.children.size() == 1 && node.children.front() != m_current;
+}
+
+void History::drop(std::size_t state) {
+    Node& node = m_nodes[state];
+
+    if (node.parent == none) {
+        // The child becomes the root, with nothing left to undo to.
+        Node& child = m_nodes[node.children.front()];
+        child.parent = none;
+        child.edits.clear();
+        child.stored = none;
+        m_bytes -= child.bytes;
+        child.bytes = 0;
+    } else {
+        Node& parent = m_nodes[node.parent];
+        std::erase(parent.children, state);
+        if (parent.redo == state) {
+            parent.redo
+                = parent.children.empty() ? none : parent.children.back();
+        }
+    }
+
+    m_bytes -= node.bytes;
+    node = Node{.time = node.time, .live = false};
+}
+
+void History::trim() {
+    while (m_bytes > m_budget) {
+        std::size_t state = m_oldest;
+        while (state < m_nodes.size() && !droppable(state)) {
+            ++state;
+        }
+        if (state == m_nodes.size()) {
+            return;
+        }
+
+        drop(state);
+        while (!m_nodes[m_oldest].live) {
+            ++m_oldest;
+        }
+    }
+}
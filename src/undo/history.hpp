@@ -0,0 +1,166 @@
+#pragma once
+
+#include "cursor.hpp"
+#include "rope/mapping.hpp"
+#include "rope/rope.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Undo history kept as a tree of states, in which undoing then editing
+// starts a new branch instead of discarding the undone one. States are
+// numbered in the order they were created, and also carry the time they
+// were. Only the text of the current state is kept: moving to another one
+// undoes edits up to their common ancestor and redoes them down from there.
+// A rope for each state would share all but the edited leaves with its
+// neighbours, but those leaves and the paths to them would add up to far
+// more than the edits, which are all the budget counts.
+//
+// A history can be stored next to the file it belongs to and restored when
+// the file is opened again. The stored edits are viewed in place, like the
+// leaves of a mapped file, so restoring reads nothing up front.
+class History {
+public:
+    using Clock = std::chrono::system_clock;
+
+    // Identifies the version of a file that a stored history belongs to.
+    struct Stamp {
+        std::uint64_t size{};
+        std::int64_t mtime{};
+
+        bool operator==(const Stamp& other) const = default;
+    };
+
+    // A replacement of `removed` at `position` by `inserted`.
+    struct Edit {
+        std::size_t position{};
+        Rope removed{};
+        Rope inserted{};
+    };
+
+    static constexpr std::size_t default_budget = 64 * 1024 * 1024;
+
+    explicit History(std::size_t budget = default_budget);
+
+    // Starts a new step: the edits recorded until the next call make up
+    // one state, and undoing it restores `cursor`.
+    void begin_step(Cursor cursor);
+
+    // Records an edit that has just been applied, leaving `rope`. Typing and
+    // deleting that continue the previous edit of the step are merged into
+    // it. Without an open step, a new one restoring `cursor` is started.
+    void record(Edit edit, Cursor cursor, const Rope& rope);
+
+    // Moves to the parent state and returns the cursor to restore. `cursor`
+    // is where redoing will put the cursor back.
+    std::optional<Cursor> undo(Rope& rope, Cursor cursor);
+    // Moves to the child state that was last left by undoing.
+    std::optional<Cursor> redo(Rope& rope);
+
+    // Moves to the state numbered `state`, or the nearest one still kept
+    // in the direction of travel, and reports whether anything changed.
+    bool jump(Rope& rope, std::size_t state);
+    // Moves to the latest state created no later than `time`.
+    bool jump(Rope& rope, Clock::time_point time);
+
+    // The edits that turn the text of state `from` into that of state
+    // `to`, in the order they apply: undoing up to the common ancestor,
+    // then redoing down.
+    std::vector<Edit> path(std::size_t from, std::size_t to);
+
+    // Number and creation time of the current state.
+    std::size_t state() const;
+    Clock::time_point time();
+
+    // The text of the parent state, without moving to it.
+    std::optional<Rope> peek_undo();
+
+    // Bytes of edited text held by the history. Once this passes the
+    // budget, the oldest states off the current path are dropped.
+    std::size_t bytes();
+    void set_budget(std::size_t budget);
+
+    // Where the history of `filename` is stored, and the stamp of the file
+    // as it is now.
+    static std::string sidecar(const std::string& filename);
+    static std::optional<Stamp> stamp(const std::string& filename);
+
+    // Stores the history for `filename`, which has just been saved from
+    // state `saved` and is now at `stamp`.
+    void store(const std::string& filename, Stamp stamp, std::size_t saved);
+    // Replaces the history with the one stored for `filename`, if it was
+    // stored for `stamp`. `text` is the file's content. Only the header is
+    // read here; the states are read on first use, and the edits of each
+    // one only once they are needed.
+    bool restore(const std::string& filename, Stamp stamp, const Rope& text);
+    // Whether a stored history turned out damaged and was dropped.
+    bool dropped() const;
+
+private:
+    static constexpr std::size_t none = -1;
+
+    struct Node {
+        std::size_t parent{none};
+        std::vector<std::size_t> children{};
+        // The child redo moves to.
+        std::size_t redo{none};
+
+        // The edits leading here from the parent. Until `stored` is none,
+        // they are still in the sidecar at that offset.
+        std::vector<Edit> edits{};
+        std::size_t stored{none};
+        std::size_t stored_edits{};
+        std::size_t bytes{};
+        Cursor before{};
+        Cursor after{};
+
+        Clock::time_point time{};
+        bool live{true};
+    };
+
+    // Indexed by state number; dropped states stay behind, emptied.
+    std::vector<Node> m_nodes{};
+    std::size_t m_current{};
+    std::size_t m_oldest{};
+    Rope m_text{};
+
+    // The sidecar a history was restored from, and the current text until
+    // its states have been read.
+    rope::Mapping::Handle m_stored{};
+    std::optional<Rope> m_unread{};
+
+    // Whether recorded edits go into the current state.
+    bool m_open{};
+    std::optional<Cursor> m_step_cursor{};
+
+    std::size_t m_bytes{};
+    std::size_t m_budget{};
+    bool m_dropped{};
+
+    static bool merge(Edit& last, const Edit& edit);
+    static std::size_t size(const Edit& edit);
+
+    std::size_t add(std::size_t parent, Cursor before);
+    // Moves to `state`, unless rebuilding its text finds the sidecar damaged,
+    // or `cursor`, which is to be restored there, does not fit that text.
+    bool move_to(std::size_t state, Rope& rope,
+                 std::optional<Cursor> cursor = {});
+    // Drops everything, as when the sidecar turns out to be damaged, but
+    // keeps a step that was begun, and notes that it did.
+    void forget();
+    void unpack();
+    // Reading the stored edits and text of a restored history checks them
+    // against the data and the text they apply to, and throws on anything
+    // that does not fit. Only the public members catch it, and forget().
+    std::vector<Edit>& edits_of(std::size_t state);
+    Rope text_of(std::size_t state);
+    std::vector<Edit> path_edits(std::size_t from, std::size_t to);
+    std::size_t nearest(std::size_t state, bool forward) const;
+    bool droppable(std::size_t state) const;
+    void drop(std::size_t state);
+    void trim();
+};
@@ -0,0 +1,399 @@
+#include "undo/journal.hpp"
+
+#include "rope/mapping.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// A journal holds a header naming the file version it applies to, then a
+// run of records, each a kind byte followed by its fields: an edit with
+// the text it inserts, or a checkpoint with the whole text. Everything is
+// in host byte order.
+constexpr char magic[8] = {'J', 'E', 'J', 'R', 'N', 'L', '0', '1'};
+
+constexpr char edit_kind = 'E';
+constexpr char checkpoint_kind = 'C';
+
+struct Header {
+    char magic[8];
+    std::uint64_t size;
+    std::int64_t mtime;
+};
+
+struct EditRecord {
+    std::uint64_t position;
+    std::uint64_t removed;
+    std::uint64_t inserted;
+};
+
+struct CheckpointRecord {
+    std::uint64_t length;
+};
+
+// Recovered text is viewed in leaves of this size.
+constexpr std::size_t chunk_size = 1024 * 1024;
+
+template<typename T>
+T read(std::string_view data, std::size_t offset) {
+    T value;
+    std::memcpy(&value, data.data() + offset, sizeof(T));
+    return value;
+}
+
+template<typename T>
+void append(std::string& bytes, const T& value) {
+    bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+bool write_all(int fd, std::string_view bytes) {
+    while (!bytes.empty()) {
+        ssize_t written = write(fd, bytes.data(), bytes.size());
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes.remove_prefix(written);
+    }
+    return true;
+}
+
+// The journal of `filename`, mapped, if it applies to the file at `stamp`.
+rope::Mapping::Handle open_journal(const std::string& filename,
+                                   History::Stamp stamp) {
+    rope::Mapping::Handle journal;
+
+    try {
+        journal = std::make_shared<const rope::Mapping>(
+            Journal::path(filename));
+    } catch (const std::runtime_error&) {
+        return nullptr;
+    }
+
+    std::string_view data = journal->view();
+    if (data.size() < sizeof(Header)) {
+        return nullptr;
+    }
+
+    auto header = read<Header>(data, 0);
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0
+        || History::Stamp{header.size, header.mtime} != stamp) {
+        return nullptr;
+    }
+
+    return journal;
+}
+
+} // namespace
+
+Journal::Journal(const std::string& filename, History::Stamp stamp,
+                 const Rope* text)
+    : m_path{path(filename)}, m_stamp{stamp} {
+    if (text != nullptr) {
+        m_texts.push_back(*text);
+        text = &m_texts.back();
+    }
+
+    m_tasks.push_back({.kind = Task::Kind::Checkpoint, .text = text});
+    m_writer = std::thread{[this] { run(); }};
+}
+
+Journal::~Journal() {
+    {
+        std::lock_guard lock{m_mutex};
+        m_stopping = true;
+    }
+    m_ready.notify_one();
+    m_writer.join();
+
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+    if (m_discarded) {
+        unlink(m_path.c_str());
+    }
+}
+
+std::string Journal::path(const std::string& filename) {
+    return filename + ".jaledit-journal";
+}
+
+void Journal::edit(std::size_t position, std::size_t removed,
+                   std::string_view inserted) {
+    if (m_failed.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    {
+        std::lock_guard lock{m_mutex};
+        std::string& bytes = append_bytes();
+        bytes += edit_kind;
+        append(bytes, EditRecord{position, removed, inserted.size()});
+        bytes += inserted;
+    }
+    m_ready.notify_one();
+
+    m_logged += sizeof(EditRecord) + inserted.size();
+}
+
+void Journal::edit(const History::Edit& edit) {
+    if (m_failed.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    {
+        std::lock_guard lock{m_mutex};
+        std::string& bytes = append_bytes();
+        bytes += edit_kind;
+        append(bytes, EditRecord{edit.position, edit.removed.length(),
+                                 edit.inserted.length()});
+        edit.inserted.for_each_chunk(
+            [&bytes](std::string_view chunk) { bytes += chunk; });
+    }
+    m_ready.notify_one();
+
+    m_logged += sizeof(EditRecord) + edit.inserted.length();
+}
+
+void Journal::checkpoint(const Rope& text) {
+    release();
+
+    if (m_failed.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    m_texts.push_back(text);
+    push({.kind = Task::Kind::Checkpoint, .text = &m_texts.back()});
+    m_logged = 0;
+}
+
+bool Journal::wants_checkpoint(std::size_t length) const {
+    return m_logged > std::max(min_checkpoint_bytes, length);
+}
+
+void Journal::discard() {
+    std::lock_guard lock{m_mutex};
+    m_discarded = true;
+}
+
+bool Journal::recoverable(const std::string& filename,
+                          History::Stamp stamp) {
+    auto journal = open_journal(filename, stamp);
+    return journal && journal->view().size() > sizeof(Header);
+}
+
+std::optional<Rope> Journal::recover(const std::string& filename,
+                                     History::Stamp stamp,
+                                     const Rope& text) {
+    auto journal = open_journal(filename, stamp);
+    if (!journal) {
+        return {};
+    }
+
+    std::string_view data = journal->view();
+    std::size_t offset = sizeof(Header);
+    Rope result = text;
+    bool replayed = false;
+
+    while (offset < data.size()) {
+        char kind = data[offset++];
+        std::size_t left = data.size() - offset;
+
+        if (kind == edit_kind && left >= sizeof(EditRecord)) {
+            auto record = read<EditRecord>(data, offset);
+            offset += sizeof(EditRecord);
+
+            if (left - sizeof(EditRecord) < record.inserted
+                || record.position > result.length()
+                || record.removed > result.length() - record.position) {
+                break;
+            }
+
+            result = result.replace(
+                record.position, record.removed,
+                Rope::from_view(journal, data.substr(offset, record.inserted),
+                                chunk_size));
+            offset += record.inserted;
+        } else if (kind == checkpoint_kind
+                   && left >= sizeof(CheckpointRecord)) {
+            auto record = read<CheckpointRecord>(data, offset);
+            offset += sizeof(CheckpointRecord);
+
+            if (left - sizeof(CheckpointRecord) < record.length) {
+                break;
+            }
+
+            result = Rope::from_view(
+                journal, data.substr(offset, record.length), chunk_size);
+            offset += record.length;
+        } else {
+            break;
+        }
+
+        replayed = true;
+    }
+
+    if (!replayed) {
+        return {};
+    }
+
+    return result;
+}
+
+// Consecutive edits share one task, so a batch is written with one call.
+std::string& Journal::append_bytes() {
+    if (m_tasks.empty() || m_tasks.back().kind != Task::Kind::Append) {
+        m_tasks.push_back({.kind = Task::Kind::Append});
+    }
+    return m_tasks.back().bytes;
+}
+
+void Journal::push(Task task) {
+    {
+        std::lock_guard lock{m_mutex};
+        m_tasks.push_back(std::move(task));
+    }
+    m_ready.notify_one();
+}
+
+// Lets go of the checkpointed texts the writer is done with, which has to
+// happen here since the reference counts are not atomic.
+void Journal::release() {
+    std::size_t written = m_written.load(std::memory_order_acquire);
+
+    for (; m_released < written; ++m_released) {
+        m_texts.pop_front();
+    }
+}
+
+void Journal::run() {
+    std::vector<Task> tasks;
+
+    while (true) {
+        {
+            std::unique_lock lock{m_mutex};
+            m_ready.wait(lock,
+                         [this] { return m_stopping || !m_tasks.empty(); });
+            if (m_tasks.empty()) {
+                return;
+            }
+            tasks.swap(m_tasks);
+        }
+
+        for (const auto& task : tasks) {
+            process(task);
+        }
+        tasks.clear();
+
+        // One sync commits everything logged while the last one ran.
+        if (m_fd != -1 && fdatasync(m_fd) == -1) {
+            fail();
+        }
+    }
+}
+
+void Journal::process(const Task& task) {
+    switch (task.kind) {
+    case Task::Kind::Append:
+        if (m_fd != -1 && !write_all(m_fd, task.bytes)) {
+            fail();
+        }
+        break;
+
+    case Task::Kind::Checkpoint:
+        if (!m_failed.load(std::memory_order_relaxed)
+            && !start_file(task.text)) {
+            fail();
+        }
+        if (task.text != nullptr) {
+            m_written.fetch_add(1, std::memory_order_release);
+        }
+        break;
+    }
+}
+
+// Writes a new journal holding just the header and, if given, a checkpoint
+// of `text`, and moves it over the old one, which stays valid until then.
+bool Journal::start_file(const Rope* text) {
+    std::string tmp_path = m_path + "-tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0600);
+    if (fd == -1) {
+        return false;
+    }
+
+    std::string bytes;
+    Header header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.size = m_stamp.size;
+    header.mtime = m_stamp.mtime;
+    append(bytes, header);
+
+    bool ok = true;
+
+    if (text != nullptr) {
+        bytes += checkpoint_kind;
+        append(bytes, CheckpointRecord{text->length()});
+        ok = write_all(fd, bytes);
+
+        // The writer reads the leaves in place without taking references.
+        for (auto chunks = text->chunks(); ok && !chunks.at_end(); ++chunks) {
+            ok = write_all(fd, *chunks);
+        }
+    } else {
+        ok = write_all(fd, bytes);
+    }
+
+    if (!ok || fdatasync(fd) == -1
+        || std::rename(tmp_path.c_str(), m_path.c_str()) == -1) {
+        close(fd);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    // As with saving, the rename is only durable once the directory is.
+    std::string directory
+        = std::filesystem::path{m_path}.parent_path().string();
+    int dir_fd = open(directory.empty() ? "." : directory.c_str(),
+                      O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd != -1) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+    m_fd = fd;
+    return true;
+}
+
+void Journal::fail() {
+    if (!m_failed.exchange(true)) {
+        std::cerr << "Could not write journal " << m_path << "\n";
+    }
+
+    if (m_fd != -1) {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
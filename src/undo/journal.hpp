@@ -0,0 +1,106 @@
+#pragma once
+
+#include "rope/rope.hpp"
+#include "undo/history.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Crash journal of a buffer: an append-only log of the changes made since
+// the file was last saved, kept next to the file. Logging a change only
+// queues a few bytes; a writer thread writes the queue out and syncs the
+// file once per batch, so everything logged while one sync runs is
+// committed together by the next. A checkpoint logs the whole text and
+// starts the file afresh from it, so recovery never replays a long log.
+class Journal {
+public:
+    // Starts the journal of `filename`, whose file on disk is at `stamp`,
+    // from `text` if it differs from the file. A journal left there before
+    // is replaced.
+    Journal(const std::string& filename, History::Stamp stamp,
+            const Rope* text = nullptr);
+    Journal(const Journal& other) = delete;
+    Journal& operator=(const Journal& other) = delete;
+    // Writes out everything logged so far, and removes the journal if it
+    // has been discarded.
+    ~Journal();
+
+    // Where the journal of `filename` is kept.
+    static std::string path(const std::string& filename);
+
+    // Logs the replacement of `removed` bytes at `position` by `inserted`.
+    void edit(std::size_t position, std::size_t removed,
+              std::string_view inserted);
+    void edit(const History::Edit& edit);
+    // Logs the whole of `text`. The writer reads it in place, so the rope
+    // is held here until it has been written.
+    void checkpoint(const Rope& text);
+    // Whether replaying what was logged since the last checkpoint would
+    // cost more than a checkpoint of `length` bytes.
+    bool wants_checkpoint(std::size_t length) const;
+
+    // Marks the journal for removal, once the file holds everything it
+    // logged.
+    void discard();
+
+    // Whether a journal with changes was left for `filename` at `stamp`.
+    static bool recoverable(const std::string& filename,
+                            History::Stamp stamp);
+    // Replays the journal left for `filename` over `text`, the content of
+    // the file at `stamp`. A change cut short by a crash ends the replay.
+    // The result views the journal in place.
+    static std::optional<Rope> recover(const std::string& filename,
+                                       History::Stamp stamp,
+                                       const Rope& text);
+
+private:
+    static constexpr std::size_t min_checkpoint_bytes = 16 * 1024 * 1024;
+
+    // A checkpoint without text starts an empty journal.
+    struct Task {
+        enum class Kind { Append, Checkpoint };
+
+        Kind kind{};
+        std::string bytes{};
+        const Rope* text{};
+    };
+
+    std::string m_path{};
+    History::Stamp m_stamp{};
+
+    // Touched by the main thread only: bytes logged since the last
+    // checkpoint, and the checkpoints not yet known to be written.
+    std::size_t m_logged{};
+    std::list<Rope> m_texts{};
+    std::size_t m_released{};
+
+    std::mutex m_mutex{};
+    std::condition_variable m_ready{};
+    std::vector<Task> m_tasks{};
+    bool m_stopping{};
+    bool m_discarded{};
+
+    std::atomic<std::size_t> m_written{};
+    std::atomic<bool> m_failed{};
+
+    // Touched by the writer thread only.
+    int m_fd{-1};
+    std::thread m_writer{};
+
+    std::string& append_bytes();
+    void push(Task task);
+    void release();
+
+    void run();
+    void process(const Task& task);
+    bool start_file(const Rope* text);
+    void fail();
+};
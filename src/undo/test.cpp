@@ -0,0 +1,489 @@
+#include "rope/rope.hpp"
+#include "test.hpp"
+#include "undo/history.hpp"
+#include "undo/journal.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <malloc.h>
+#include <unistd.h>
+
+// Checks the undo history and the crash journal, with files in the
+// temporary directory where they need them.
+
+namespace {
+
+// A file in the temporary directory, removed along with whatever was kept
+// next to it.
+class TempFile {
+public:
+    TempFile(std::string_view name, std::string_view content)
+        : m_path{(std::filesystem::temp_directory_path()
+                  / ("jaledit-test-" + std::to_string(getpid()) + "-"
+                     + std::string{name}))
+                     .string()} {
+        write(m_path, content);
+    }
+
+    ~TempFile() {
+        std::filesystem::remove(m_path);
+        std::filesystem::remove(Journal::path(m_path));
+        std::filesystem::remove(History::sidecar(m_path));
+    }
+
+    const std::string& path() const { return m_path; }
+    History::Stamp stamp() const { return *History::stamp(m_path); }
+
+    static void write(const std::string& path, std::string_view content) {
+        std::ofstream file{path, std::ios::binary | std::ios::trunc};
+        file << content;
+    }
+
+    static std::string read(const std::string& path) {
+        std::ifstream file{path, std::ios::binary};
+        return {std::istreambuf_iterator<char>{file}, {}};
+    }
+
+private:
+    std::string m_path;
+};
+
+// Applies a replacement to `text` and records it, as the buffer does.
+void apply(History& history, Rope& text, std::size_t position,
+           std::size_t removed, const std::string& inserted) {
+    History::Edit edit{position, text.slice(position, removed),
+                       Rope{inserted}};
+    text = text.replace(position, removed, inserted);
+    history.record(std::move(edit), Cursor{}, text);
+}
+
+// Applies edits given by History::path to `text`.
+Rope replay(Rope text, const std::vector<History::Edit>& edits) {
+    for (const auto& edit : edits) {
+        text = text.replace(edit.position, edit.removed.length(),
+                            edit.inserted);
+    }
+
+    return text;
+}
+
+void test_undo_tree() {
+    History history;
+    Rope text{std::string{"one\n"}};
+
+    history.begin_step({0, 3});
+    apply(history, text, 3, 0, " two");
+    history.begin_step({0, 7});
+    apply(history, text, 7, 0, " three");
+    test::expect_equal(history.state(), std::size_t{2});
+
+    auto cursor = history.undo(text, {0, 13});
+    test::expect(cursor == Cursor{0, 7});
+    test::expect_equal(text, std::string{"one two\n"});
+
+    // Editing after undoing starts a branch and keeps the undone state.
+    history.begin_step({0, 7});
+    apply(history, text, 7, 0, " four");
+    test::expect_equal(history.state(), std::size_t{3});
+
+    history.undo(text, {0, 12});
+    cursor = history.redo(text);
+    test::expect(cursor == Cursor{0, 12});
+    test::expect_equal(text, std::string{"one two four\n"});
+
+    test::expect(history.jump(text, 2));
+    test::expect_equal(text, std::string{"one two three\n"});
+    test::expect(!history.jump(text, 2));
+
+    // Paths go up to the common ancestor and down the other branch.
+    test::expect_equal(replay(text, history.path(2, 3)),
+                       std::string{"one two four\n"});
+    test::expect_equal(replay(text, history.path(2, 0)),
+                       std::string{"one\n"});
+    test::expect(history.path(2, 2).empty());
+
+    test::expect(history.jump(text, 0));
+    test::expect_equal(text, std::string{"one\n"});
+    test::expect(!history.undo(text, {}));
+    test::expect(!history.peek_undo());
+}
+
+// Typing and deleting that continue the last edit of a step join it.
+void test_merged_edits() {
+    History history;
+    Rope text{std::string{"ab\n"}};
+
+    history.begin_step({});
+    for (char c : std::string{"xyz"}) {
+        apply(history, text, 1 + (c - 'x'), 0, std::string(1, c));
+    }
+    apply(history, text, 3, 1, "");
+    apply(history, text, 3, 1, "");
+
+    test::expect_equal(text, std::string{"axy\n"});
+    auto edits = history.path(0, 1);
+    test::expect_equal(edits.size(), std::size_t{1});
+    if (edits.size() == 1) {
+        test::expect_equal(edits[0].removed, std::string{"b"});
+        test::expect_equal(edits[0].inserted, std::string{"xy"});
+    }
+
+    // Typing elsewhere is an edit of its own.
+    apply(history, text, 0, 0, "<");
+    test::expect_equal(history.path(0, 1).size(), std::size_t{2});
+    test::expect_equal(*history.peek_undo(), std::string{"ab\n"});
+}
+
+// Past the budget, the oldest states off the current path go first, and
+// then the oldest on it, always leaving the latest step to undo.
+void test_budget() {
+    History history{1000};
+    Rope text{std::string{}};
+
+    history.begin_step({});
+    apply(history, text, 0, 0, std::string(100, 'a'));
+    history.undo(text, {});
+
+    for (char c = 'b'; c < 'b' + 9; ++c) {
+        history.begin_step({});
+        apply(history, text, text.length(), 0, std::string(100, c));
+    }
+    test::expect_equal(history.bytes(), std::size_t{1000});
+
+    history.set_budget(900);
+    test::expect_equal(history.bytes(), std::size_t{900});
+    history.jump(text, 0);
+    test::expect(history.jump(text, 1));
+    test::expect_equal(history.state(), std::size_t{2});
+    test::expect_equal(text, std::string(100, 'b'));
+
+    history.jump(text, 10);
+    history.set_budget(250);
+    test::expect(history.bytes() <= 250);
+    test::expect(history.jump(text, 0));
+    test::expect(history.state() >= 8);
+    test::expect(!history.undo(text, {}));
+
+    history.jump(text, 10);
+    test::expect_equal(history.state(), std::size_t{10});
+    test::expect(history.undo(text, {}).has_value());
+    test::expect_equal(text.length(), std::size_t{800});
+
+    // States past the current one are dead ends as far as trimming goes.
+    history.set_budget(0);
+    test::expect(!history.redo(text));
+    test::expect(history.undo(text, {}).has_value());
+
+    // Nor does the history hold much more than it counts. Typing all over
+    // a large file edits a different leaf with every step, and keeping the
+    // text of each state would keep a copy of each of those leaves.
+    std::mt19937_64 random{15};
+    text = Rope{std::string(std::size_t{1} << 20, 'a')};
+    std::optional<History> typed{History{64 * 1024}};
+    std::size_t steps = 2000;
+
+    for (std::size_t i = 0; i < steps; ++i) {
+        typed->begin_step({});
+        std::size_t at = random() % (text.length() - 1);
+        apply(*typed, text, at, i % 2, i % 2 == 0 ? "x" : "");
+    }
+    test::expect(typed->bytes() <= 64 * 1024);
+
+    std::size_t with = mallinfo2().uordblks;
+    typed.reset();
+    std::size_t held = with - mallinfo2().uordblks;
+
+    // A leaf is up to 4096 bytes; the states themselves take about 150.
+    test::expect(held < steps * 512);
+}
+
+// Builds a history with a branch and leaves the file as its current text.
+History make_history(const TempFile& file, Rope& text) {
+    History history;
+    text = Rope{std::string{"first line\n"}};
+
+    for (std::size_t i = 0; i < 6; ++i) {
+        history.begin_step({static_cast<int>(i), 0});
+        apply(history, text, text.length(), 0,
+              "line " + std::to_string(i) + "\n");
+        apply(history, text, 0, 1, "F");
+    }
+    history.jump(text, 3);
+    history.begin_step({});
+    apply(history, text, 5, 6, "branch");
+
+    TempFile::write(file.path(), text.to_string());
+    return history;
+}
+
+void test_sidecar_round_trip() {
+    TempFile file{"history", ""};
+    Rope text;
+    History history = make_history(file, text);
+    history.store(file.path(), file.stamp(), history.state());
+
+    History restored;
+    test::expect(restored.restore(file.path(), file.stamp(), text));
+    test::expect_equal(restored.state(), history.state());
+
+    // Every state comes back with its text, whichever way it is reached.
+    Rope expected = text;
+    Rope actual = text;
+    for (std::size_t state : {7, 2, 6, 0, 5, 7}) {
+        history.jump(expected, state);
+        restored.jump(actual, state);
+        test::expect_equal(restored.state(), history.state());
+        test::expect(actual == expected);
+    }
+    restored.jump(actual, 6);
+    test::expect(restored.undo(actual, {}) == Cursor{5, 0});
+    test::expect(restored.path(2, 7).size() == history.path(2, 7).size());
+
+    // A history only goes with the version of the file it was stored for.
+    History other;
+    test::expect(!other.restore(file.path(), {0, 0}, text));
+    TempFile::write(file.path(), "changed\n");
+    test::expect(!other.restore(file.path(), file.stamp(), text));
+}
+
+// A damaged sidecar is dropped whenever it turns out to be, leaving a
+// history that starts over from the current text.
+void test_damaged_sidecar() {
+    TempFile file{"damaged", ""};
+    Rope text;
+    History history = make_history(file, text);
+    history.store(file.path(), file.stamp(), history.state());
+
+    std::string sidecar = History::sidecar(file.path());
+    std::string stored = TempFile::read(sidecar);
+    std::mt19937_64 random{16};
+
+    for (std::size_t round = 0; round < 200; ++round) {
+        std::string damaged = stored;
+
+        if (round % 4 == 0) {
+            damaged.resize(damaged.size() * round / 200);
+        } else {
+            std::uniform_int_distribution<std::size_t> at{0,
+                                                          damaged.size() - 1};
+            for (std::size_t i = 0; i < round % 8 + 1; ++i) {
+                damaged[at(random)] = static_cast<char>(random());
+            }
+        }
+        TempFile::write(sidecar, damaged);
+
+        History restored;
+        Rope current = text;
+        restored.restore(file.path(), file.stamp(), current);
+
+        for (std::size_t state : {0, 7, 3, 5}) {
+            restored.jump(current, state);
+            restored.path(0, state);
+        }
+        restored.peek_undo();
+        restored.undo(current, {});
+        restored.redo(current);
+
+        // Whatever was left, edits are still recorded and undone.
+        Rope before = current;
+        restored.begin_step({});
+        apply(restored, current, 0, 0, "x");
+        test::expect(restored.undo(current, {}).has_value());
+        test::expect(current == before);
+    }
+
+    // Nor are cursors that do not fit the text of their state handed out
+    // to be put in place; the history is dropped instead.
+    for (Cursor bad : {Cursor{9, 0}, Cursor{0, 40}, Cursor{-1, 0}}) {
+        History history;
+        text = Rope{std::string{"one\ntwo\n"}};
+        history.begin_step(bad);
+        apply(history, text, 8, 0, "three\n");
+        history.begin_step({2, 0});
+        apply(history, text, 14, 0, "four\n");
+        history.undo(text, bad);
+        history.store(file.path(), file.stamp(), history.state());
+
+        for (bool undo : {true, false}) {
+            History restored;
+            Rope current = text;
+            restored.restore(file.path(), file.stamp(), current);
+
+            test::expect(!restored.dropped());
+            auto cursor = undo ? restored.undo(current, {})
+                               : restored.redo(current);
+            test::expect(!cursor);
+            test::expect(restored.dropped());
+            test::expect(current == text);
+            test::expect(!restored.undo(current, {}));
+        }
+    }
+}
+
+struct Change {
+    std::size_t position;
+    std::size_t removed;
+    std::string_view inserted;
+};
+
+// Logs the first `count` changes in a new journal, after a checkpoint of
+// `start` if given, and returns what it left on disk.
+std::string log_changes(const TempFile& file,
+                        const std::vector<Change>& changes, std::size_t count,
+                        const Rope* start = nullptr) {
+    {
+        Journal journal{file.path(), file.stamp(), start};
+        for (std::size_t i = 0; i < count; ++i) {
+            journal.edit(changes[i].position, changes[i].removed,
+                         changes[i].inserted);
+        }
+    }
+
+    return TempFile::read(Journal::path(file.path()));
+}
+
+void test_recover_cut_off_journal() {
+    TempFile file{"cut", "hello world\n"};
+    std::vector<Change> changes{{0, 5, "howdy"}, {11, 0, "!"}, {0, 0, "oh, "}};
+    std::vector<std::string> texts{"hello world\n", "howdy world\n",
+                                   "howdy world!\n", "oh, howdy world!\n"};
+
+    // Where each record ends, from journals cut short after it.
+    std::vector<std::size_t> ends;
+    for (std::size_t count = 0; count <= changes.size(); ++count) {
+        ends.push_back(log_changes(file, changes, count).size());
+    }
+    std::string full = log_changes(file, changes, changes.size());
+
+    test::expect(Journal::recoverable(file.path(), file.stamp()));
+    auto recovered
+        = Journal::recover(file.path(), file.stamp(), Rope{texts[0]});
+    test::expect(recovered.has_value());
+    if (recovered) {
+        test::expect_equal(*recovered, texts.back());
+    }
+
+    // A crash can stop the journal anywhere; the records written whole are
+    // replayed, and what follows them is ignored.
+    for (std::size_t cut = ends[0]; cut < full.size(); ++cut) {
+        TempFile::write(Journal::path(file.path()), full.substr(0, cut));
+
+        std::size_t whole = 0;
+        while (whole + 1 < ends.size() && ends[whole + 1] <= cut) {
+            ++whole;
+        }
+
+        auto text
+            = Journal::recover(file.path(), file.stamp(), Rope{texts[0]});
+        test::expect(text.has_value() == (whole > 0));
+        if (text && whole > 0) {
+            test::expect_equal(*text, texts[whole]);
+        }
+    }
+
+    // Nor does anything apply to another version of the file.
+    TempFile::write(Journal::path(file.path()), full);
+    TempFile::write(file.path(), "changed elsewhere\n");
+    test::expect(!Journal::recoverable(file.path(), file.stamp()));
+    test::expect(
+        !Journal::recover(file.path(), file.stamp(), Rope{texts[0]}));
+}
+
+void test_recover_typed_text() {
+    TempFile file{"typed", "int x;\n"};
+
+    // The buffer logs each keystroke as it goes into the gap, and a
+    // backspace within it as it takes one back, long before the run is
+    // flushed into the history.
+    std::vector<Change> changes{{6, 0, "\n"}, {7, 0, "i"}, {8, 0, "n"},
+                                {9, 0, "r"},  {9, 1, ""},  {9, 0, "t"},
+                                {10, 0, " "}, {11, 0, "y"}, {12, 0, ";"}};
+    std::vector<std::string> texts{"int x;\n"};
+    for (const auto& change : changes) {
+        std::string text = texts.back();
+        text.replace(change.position, change.removed, change.inserted);
+        texts.push_back(text);
+    }
+    test::expect_equal(texts.back(), std::string{"int x;\nint y;\n"});
+
+    // Whichever keystroke a crash comes after, everything typed up to it
+    // is recovered, without the run ever having been flushed.
+    for (std::size_t count = 1; count <= changes.size(); ++count) {
+        log_changes(file, changes, count);
+
+        auto text = Journal::recover(file.path(), file.stamp(),
+                                     Rope{texts[0]});
+        test::expect(text.has_value());
+        if (text) {
+            test::expect_equal(*text, texts[count]);
+        }
+    }
+}
+
+void test_recover_journal_written_while_saving() {
+    TempFile file{"saving", "version one\n"};
+    History::Stamp before_save = file.stamp();
+
+    // While a save runs, the file may hold either text, so the journal
+    // starts from a checkpoint of the text being edited.
+    Rope snapshot{"version two\n"};
+    std::vector<Change> changes{{8, 3, "2"}, {0, 0, "// "}};
+    log_changes(file, changes, changes.size(), &snapshot);
+    std::string expected = "// version 2\n";
+
+    for (const auto& base : {"version one\n", "version two\n"}) {
+        auto text = Journal::recover(file.path(), before_save, Rope{base});
+        test::expect(text.has_value());
+        if (text) {
+            test::expect_equal(*text, expected);
+        }
+    }
+
+    // Cut off in the middle of the last edit, it still recovers the
+    // checkpoint and the edit before.
+    std::string full = TempFile::read(Journal::path(file.path()));
+    std::size_t first = log_changes(file, changes, 1, &snapshot).size();
+    TempFile::write(Journal::path(file.path()),
+                    full.substr(0, (first + full.size()) / 2));
+
+    auto text
+        = Journal::recover(file.path(), before_save, Rope{"version one\n"});
+    test::expect(text.has_value());
+    if (text) {
+        test::expect_equal(*text, std::string{"version 2\n"});
+    }
+
+    // Once the save is through, the buffer discards the journal, which
+    // then leaves nothing behind.
+    {
+        Journal journal{file.path(), before_save, &snapshot};
+        journal.edit(0, 0, "x");
+        journal.discard();
+    }
+    test::expect(!Journal::recoverable(file.path(), before_save));
+}
+
+} // namespace
+
+int main() {
+    test::run("undo tree", test_undo_tree);
+    test::run("merged edits", test_merged_edits);
+    test::run("budget", test_budget);
+    test::run("sidecar round trip", test_sidecar_round_trip);
+    test::run("damaged sidecar", test_damaged_sidecar);
+    test::run("recover cut-off journal", test_recover_cut_off_journal);
+    test::run("recover typed text", test_recover_typed_text);
+    test::run("recover journal written while saving",
+              test_recover_journal_written_while_saving);
+
+    return test::result();
+}